@@ -0,0 +1,139 @@
+
+#ifndef _AUTOTUNE_H_
+#define _AUTOTUNE_H_
+
+#include <chrono>
+#include <limits>
+#include <vector>
+#include <cstddef>
+#include "Matrix.h"
+#include "Tuning.h"
+
+// best wall time of a few runs in seconds
+template<typename F>
+inline double benchmark(F f, size_t runs = 3)
+{
+	double best = std::numeric_limits<double>::infinity();
+	for (size_t r = 0; r < runs; r++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		f();
+		std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+		if (t.count() < best)
+			best = t.count();
+	}
+	return best;
+}
+
+// dense sample of order n, a rank one update of the identity,
+// so that exact elimination keeps its entries small
+template<typename T>
+inline Matrix<T> tuning_sample(size_t n, unsigned seed)
+{
+	Matrix<T> A(n, n);
+	for (size_t i = 0; i < n; i++)
+		for (size_t j = 0; j < n; j++)
+			A.get(i, j) = static_cast<T>(static_cast<unsigned>((i == j) + ((i + seed) % 3 != 0) * ((j * seed) % 2 + 1)));
+	return A;
+}
+
+// micro-benchmark the kernel parameters of T on samples of order up to size
+template<typename T>
+inline TuningParams autotune(size_t size = 128)
+{
+	TuningParams p = default_tuning(), q;
+	size_t hw = p.mul_threads;
+	Matrix<T> A = tuning_sample<T>(size, 1), B = tuning_sample<T>(size, 2);
+	std::vector<size_t> threads;
+	for (size_t t = 1; t < hw; t *= 2)
+		threads.push_back(t);
+	threads.push_back(hw);
+	std::vector<size_t> orders;
+	for (size_t n = 8; n < size; n += n / 2)
+		orders.push_back(n);
+	orders.push_back(size);
+	double best;
+
+	// product: tile edge on one thread, then threads, then the smallest order worth threads
+	q = p;
+	q.mul_threads = 1;
+	best = std::numeric_limits<double>::infinity();
+	for (size_t b = 8; b <= size; b *= 2)
+	{
+		q.mul_block = b;
+		double t = benchmark([&]() {A.multiply(B, q);});
+		if (t < best)
+			best = t, p.mul_block = b;
+	}
+	q = p;
+	q.mul_parallel = 0;
+	best = std::numeric_limits<double>::infinity();
+	for (size_t n : threads)
+	{
+		q.mul_threads = n;
+		double t = benchmark([&]() {A.multiply(B, q);});
+		if (t < best)
+			best = t, p.mul_threads = n;
+	}
+	q = p;
+	q.mul_parallel = 0;
+	p.mul_parallel = std::numeric_limits<size_t>::max();
+	if (p.mul_threads > 1)
+		for (size_t n : orders)
+		{
+			Matrix<T> C = tuning_sample<T>(n, 1), D = tuning_sample<T>(n, 2);
+			TuningParams serial = q;
+			serial.mul_threads = 1;
+			if (benchmark([&]() {C.multiply(D, q);}) < benchmark([&]() {C.multiply(D, serial);}))
+			{
+				p.mul_parallel = n * n * n;
+				break;
+			}
+		}
+
+	// elimination: threads, then the smallest order worth threads
+	q = p;
+	q.ref_parallel = 0;
+	best = std::numeric_limits<double>::infinity();
+	for (size_t n : threads)
+	{
+		q.ref_threads = n;
+		double t = benchmark([&]() {Matrix<T>(A).reduce_to_ref(0, q);});
+		if (t < best)
+			best = t, p.ref_threads = n;
+	}
+	q = p;
+	q.ref_parallel = 0;
+	p.ref_parallel = std::numeric_limits<size_t>::max();
+	if (p.ref_threads > 1)
+		for (size_t n : orders)
+		{
+			Matrix<T> C = tuning_sample<T>(n, 1);
+			TuningParams serial = q;
+			serial.ref_threads = 1;
+			if (benchmark([&]() {Matrix<T>(C).reduce_to_ref(0, q);}) < benchmark([&]() {Matrix<T>(C).reduce_to_ref(0, serial);}))
+			{
+				p.ref_parallel = n * n;
+				break;
+			}
+		}
+
+	// determinant: the largest order where cofactor expansion still wins,
+	// the row kernel types never expand by cofactors
+	if constexpr (!frac_kernel<T>::value)
+	{
+		q = p;
+		q.det_naive = 0;
+		p.det_naive = 1;
+		for (size_t n = 2; n <= 8; n++)
+		{
+			Matrix<T> C = tuning_sample<T>(n, 1);
+			if (benchmark([&]() {C.det_naive();}, 20) > benchmark([&]() {C.det(q);}, 20))
+				break;
+			p.det_naive = n;
+		}
+	}
+	return p;
+}
+
+#endif
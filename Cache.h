@@ -0,0 +1,98 @@
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <cstddef>
+#include <utility>
+
+// least recently used cache bounded by the total cost of its values
+template<typename K, typename V, typename Hash = std::hash<K>>
+class LRUCache
+{
+	private:
+		struct item
+		{
+			K key;
+			V value;
+			size_t cost;
+		};
+		typedef std::list<item> list_t;
+
+		size_t limit, used;
+		// most recently used first
+		list_t items;
+		std::unordered_map<K, typename list_t::iterator, Hash> index;
+
+		inline void evict()
+		{
+			while (used > limit && !items.empty())
+			{
+				used -= items.back().cost;
+				index.erase(items.back().key);
+				items.pop_back();
+			}
+		}
+
+	public:
+		inline LRUCache(size_t capacity) : limit(capacity), used(0) {}
+
+		// look up a value and mark it most recently used
+		inline bool get(const K &key, V &value)
+		{
+			auto it = index.find(key);
+			if (it == index.end())
+				return false;
+			items.splice(items.begin(), items, it->second);
+			value = it->second->value;
+			return true;
+		}
+
+		// insert or replace a value, evicting the least recently used ones over capacity
+		// values costing more than the whole capacity are not stored
+		inline LRUCache & put(const K &key, const V &value, size_t cost)
+		{
+			erase(key);
+			if (cost > limit)
+				return *this;
+			items.push_front(item{key, value, cost});
+			index[key] = items.begin();
+			used += cost;
+			evict();
+			return *this;
+		}
+
+		// remove a value
+		inline LRUCache & erase(const K &key)
+		{
+			auto it = index.find(key);
+			if (it != index.end())
+			{
+				used -= it->second->cost;
+				items.erase(it->second);
+				index.erase(it);
+			}
+			return *this;
+		}
+
+		// remove all values
+		inline LRUCache & clear()
+		{
+			items.clear();
+			index.clear();
+			used = 0;
+			return *this;
+		}
+
+		// capacity
+		inline size_t capacity() const {return limit;}
+		inline LRUCache & capacity(size_t c) {limit = c; evict(); return *this;}
+
+		// number of values and their total cost
+		inline size_t size() const {return items.size();}
+		inline size_t cost() const {return used;}
+};
+
+#endif
@@ -0,0 +1,144 @@
+
+#ifndef _ECHELON_H_
+#define _ECHELON_H_
+
+#include <stdexcept>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include "Vector.h"
+#include "Matrix.h"
+#include "FracVector.h"
+
+// row storage and row operations used by Echelon
+template<typename T, bool F = frac_kernel<T>::value>
+struct echelon_row
+{
+	typedef std::vector<T> type;
+	static inline bool is_zero(const type &r, size_t j) {return r[j] == static_cast<T>(0);}
+	static inline T get(const type &r, size_t j) {return r[j];}
+	static inline void div(type &r, T c)
+	{
+		for (T &x : r)
+			x /= c;
+	}
+	static inline void sub_mul(type &r, T c, const type &y)
+	{
+		for (size_t k = 0; k < r.size(); k++)
+			if (y[k] != static_cast<T>(0))
+				r[k] -= y[k] * c;
+	}
+	static inline std::vector<T> to_vector(const type &r) {return r;}
+};
+template<typename T>
+struct echelon_row<Frac<T>, true>
+{
+	typedef FracVector<T> type;
+	static inline bool is_zero(const type &r, size_t j) {return r.is_zero(j);}
+	static inline Frac<T> get(const type &r, size_t j) {return r[j];}
+	static inline void div(type &r, Frac<T> c) {r /= c;}
+	static inline void sub_mul(type &r, Frac<T> c, const type &y) {r.sub_mul(c, y);}
+	static inline std::vector<Frac<T>> to_vector(const type &r) {return r;}
+};
+
+// reduced echelon form maintained incrementally as rows are appended
+// each appended row is reduced against the current basis and, if it
+// introduces a pivot, back-substituted into the basis, in O(rank * col)
+template<typename T>
+class Echelon
+{
+	private:
+		typedef echelon_row<T> R;
+		typedef typename R::type row_t;
+
+		size_t num_col, num_aug, num_row;
+		bool inconsistent;
+		// reduced rows sorted by pivot column
+		std::vector<row_t> basis;
+		std::vector<size_t> pivot;
+
+	public:
+		// constructors
+		inline Echelon(size_t col, size_t aug = 0) : num_col(col), num_aug(aug), num_row(0), inconsistent(false)
+		{
+			if (aug > col)
+				throw std::invalid_argument("augmented columns exceed number of columns");
+		}
+		inline Echelon(const Matrix<T> &A, size_t aug = 0) : Echelon(A.col(), aug)
+		{
+			for (size_t i = 0; i < A.row(); i++)
+				add_row(A.row(i));
+		}
+
+		// append a row
+		template<bool C>
+		inline Echelon & add_row(const Vector<T, C> &v)
+		{
+			return add_row(std::vector<T>(v.begin(), v.end()));
+		}
+		inline Echelon & add_row(const std::vector<T> &v)
+		{
+			if (v.size() != num_col)
+				throw std::invalid_argument("adding rows with different dimensions");
+			num_row++;
+			row_t r(v);
+
+			// reduce against the basis
+			for (size_t k = 0; k < basis.size(); k++)
+				if (!R::is_zero(r, pivot[k]))
+					R::sub_mul(r, R::get(r, pivot[k]), basis[k]);
+
+			// find the new pivot
+			size_t j = 0;
+			while (j < num_col - num_aug && R::is_zero(r, j))
+				j++;
+			if (j == num_col - num_aug)
+			{
+				for (; j < num_col; j++)
+					if (!R::is_zero(r, j))
+						inconsistent = true;
+				return *this;
+			}
+
+			// back-substitute into the basis
+			R::div(r, R::get(r, j));
+			for (row_t &b : basis)
+				if (!R::is_zero(b, j))
+					R::sub_mul(b, R::get(b, j), r);
+			size_t pos = std::lower_bound(pivot.begin(), pivot.end(), j) - pivot.begin();
+			pivot.insert(pivot.begin() + pos, j);
+			basis.insert(basis.begin() + pos, std::move(r));
+			return *this;
+		}
+
+		// number of appended rows
+		inline size_t row() const {return num_row;}
+
+		// number of columns
+		inline size_t col() const {return num_col;}
+
+		// rank of the coefficient part
+		inline size_t rank() const {return basis.size();}
+
+		// pivot columns in increasing order
+		inline const std::vector<size_t> & pivots() const {return pivot;}
+
+		// check if the augmented system is consistent
+		inline bool consistent() const {return !inconsistent;}
+
+		// reduced echelon form, basis rows followed by zero rows
+		// same as ref(aug) of the appended rows when the system is consistent
+		inline Matrix<T> matrix() const
+		{
+			Matrix<T> A(num_row, num_col);
+			for (size_t i = 0; i < basis.size(); i++)
+			{
+				std::vector<T> v = R::to_vector(basis[i]);
+				for (size_t j = 0; j < num_col; j++)
+					A.get(i, j) = v[j];
+			}
+			return A;
+		}
+};
+
+#endif
@@ -9,6 +9,8 @@
 #include <ostream>
 #include <string>
 #include <sstream>
+#include <cmath>
+#include <limits>
 
 template<typename T>
 class Frac
@@ -178,4 +180,31 @@ inline std::basic_istream<Char> & operator>>(std::basic_istream<Char> &is, Frac<
 	return is;
 }
 
+// fraction closest to x among the convergents of its continued fraction,
+// the first within a relative error of tol or the last that fits in T
+template<typename T>
+inline Frac<T> approximate_frac(double x, double tol = 0)
+{
+	if (!std::isfinite(x))
+		throw std::invalid_argument("fraction approximating a non-finite number");
+	const double max = static_cast<double>(std::numeric_limits<T>::max());
+	double a = std::fabs(x), r = a;
+	// the two latest convergents p1/q1 and p0/q0
+	double p0 = 0, q0 = 1, p1 = 1, q1 = 0;
+	for (;;)
+	{
+		double c = std::floor(r);
+		double p = c * p1 + p0, q = c * q1 + q0;
+		if (p > max || q > max)
+			break;
+		p0 = p1, q0 = q1, p1 = p, q1 = q;
+		if (std::fabs(a - p / q) <= tol * a || r == c)
+			break;
+		r = 1 / (r - c);
+	}
+	if (q1 == 0)
+		throw std::invalid_argument("fraction approximating a number out of range");
+	return Frac<T>(static_cast<T>(p1), static_cast<T>(q1), x < 0);
+}
+
 #endif
@@ -0,0 +1,455 @@
+
+#ifndef _FRACVECTOR_H_
+#define _FRACVECTOR_H_
+
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include <numeric>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <atomic>
+#include <algorithm>
+#include "Vector.h"
+#include "Frac.h"
+#include "Tuning.h"
+#include "Pipeline.h"
+
+// wide signed integer used by the row kernels, void if T has none
+template<typename T>
+struct frac_wide
+{
+	typedef typename std::conditional<std::is_integral<T>::value && std::is_unsigned<T>::value && sizeof(T) <= 4, int64_t, void>::type type;
+};
+
+// check if T is a Frac that the row kernels can handle
+template<typename T>
+struct frac_kernel
+{
+	static constexpr bool value = false;
+};
+template<typename T>
+struct frac_kernel<Frac<T>>
+{
+	static constexpr bool value = !std::is_void<typename frac_wide<T>::type>::value;
+};
+
+// allocator returning cache line aligned arrays
+template<typename T, size_t N = 64>
+struct aligned_allocator
+{
+	typedef T value_type;
+	template<typename U>
+	struct rebind {typedef aligned_allocator<U, N> other;};
+
+	inline aligned_allocator() {}
+	template<typename U>
+	inline aligned_allocator(const aligned_allocator<U, N> &) {}
+
+	inline T * allocate(size_t n) {return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(N)));}
+	inline void deallocate(T *p, size_t) {::operator delete(p, std::align_val_t(N));}
+
+	template<typename U>
+	inline bool operator==(const aligned_allocator<U, N> &) const {return true;}
+	template<typename U>
+	inline bool operator!=(const aligned_allocator<U, N> &) const {return false;}
+};
+
+// cross-multiplying loops of the row kernels on 64 bit numerators and denominators;
+// the default x86-64 target has no vector 64 bit multiply, so on x86-64 they are
+// also compiled for AVX2 and the variant is picked once at load time
+#if defined(__x86_64__) && defined(__GNUC__)
+#define FRAC_KERNEL __attribute__((target_clones("arch=x86-64-v3", "default")))
+#else
+#define FRAC_KERNEL
+#endif
+
+// rn / rd = n / d * a / b
+FRAC_KERNEL inline void frac_scale_kernel(const int64_t *__restrict n, const int64_t *__restrict d, int64_t a, int64_t b,
+	int64_t *__restrict rn, int64_t *__restrict rd, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		rn[i] = n[i] * a;
+		rd[i] = d[i] * b;
+	}
+}
+
+// rn / rd = xn / xd - a / b * yn / yd, copying x where y is zero
+FRAC_KERNEL inline void frac_sub_mul_kernel(const int64_t *__restrict xn, const int64_t *__restrict xd, int64_t a, int64_t b,
+	const int64_t *__restrict yn, const int64_t *__restrict yd, int64_t *__restrict rn, int64_t *__restrict rd, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		int64_t bd = b * yd[i];
+		rn[i] = yn[i] != 0 ? xn[i] * bd - a * yn[i] * xd[i] : xn[i];
+		rd[i] = yn[i] != 0 ? xd[i] * bd : xd[i];
+	}
+}
+
+// vector of Frac<T> stored as separate arrays of numerators and denominators
+// row operations cross-multiply whole rows in the branch-free kernels above,
+// normalize once per entry at the end of the operation, and fall back
+// to the scalar Frac arithmetic when the wide integers could overflow
+template<typename T>
+class FracVector
+{
+	public:
+		typedef typename frac_wide<T>::type W;
+		static_assert(std::is_same<W, int64_t>::value, "FracVector requires an unsigned integer of at most 32 bits");
+		typedef std::vector<W, aligned_allocator<W>> array;
+
+	private:
+		// signed numerators and positive denominators
+		array n, d;
+
+		// number of bits a product may use without overflowing W
+		static constexpr int wide_bits = std::numeric_limits<W>::digits - 1;
+
+		// scratch arrays for results, swapped in when an operation succeeds
+		static inline array & scratch_num() {static thread_local array a; return a;}
+		static inline array & scratch_den() {static thread_local array a; return a;}
+
+		// bit length of the largest magnitude stored
+		inline int bits() const
+		{
+			W m = 0;
+			for (size_t i = 0; i < size(); i++)
+				m |= (n[i] < 0 ? -n[i] : n[i]) | d[i];
+			return bit_length(m);
+		}
+		static inline int bit_length(W m)
+		{
+			int b = 0;
+			for (; m != 0; m >>= 1)
+				b++;
+			return b;
+		}
+
+		// normalize entries of the scratch arrays, reports whether they fit in T
+		static inline bool normalize(array &rn, array &rd, const W *mask = nullptr)
+		{
+			W m = 0;
+			for (size_t i = 0; i < rn.size(); i++)
+			{
+				if (mask == nullptr || mask[i] != 0)
+				{
+					W c = std::gcd(rn[i], rd[i]);
+					rn[i] /= c;
+					rd[i] /= c;
+				}
+				m |= (rn[i] < 0 ? -rn[i] : rn[i]) | rd[i];
+			}
+			return bit_length(m) <= std::numeric_limits<T>::digits;
+		}
+
+	public:
+		// constructors
+		inline FracVector(size_t size = 0) : n(size, 0), d(size, 1) {}
+		inline FracVector(const std::vector<Frac<T>> &v) : n(v.size()), d(v.size())
+		{
+			for (size_t i = 0; i < v.size(); i++)
+				set(i, v[i]);
+		}
+		template<bool C>
+		inline FracVector(const Vector<Frac<T>, C> &v) : n(v.size()), d(v.size())
+		{
+			for (size_t i = 0; i < v.size(); i++)
+				set(i, v[i]);
+		}
+
+		// size
+		inline size_t size() const {return n.size();}
+
+		// raw arrays
+		inline const W * num() const {return n.data();}
+		inline const W * den() const {return d.data();}
+
+		// accessors
+		inline Frac<T> operator[](size_t i) const
+		{
+			return Frac<T>(static_cast<T>(n[i] < 0 ? -n[i] : n[i]), static_cast<T>(d[i]), n[i] < 0);
+		}
+		inline FracVector & set(size_t i, const Frac<T> &f)
+		{
+			n[i] = f.neg ? -static_cast<W>(f.num) : static_cast<W>(f.num);
+			d[i] = static_cast<W>(f.den);
+			return *this;
+		}
+		inline bool is_zero(size_t i) const {return n[i] == 0;}
+
+		// cast into std::vector
+		inline operator std::vector<Frac<T>>() const
+		{
+			std::vector<Frac<T>> v;
+			v.reserve(size());
+			for (size_t i = 0; i < size(); i++)
+				v.push_back((*this)[i]);
+			return v;
+		}
+
+		// compound division by a scalar
+		inline FracVector & operator/=(const Frac<T> &c)
+		{
+			if (c.num == 0)
+				throw std::invalid_argument("Denominator is 0");
+			W a = c.neg ? -static_cast<W>(c.den) : static_cast<W>(c.den);
+			W b = static_cast<W>(c.num);
+			if (bits() + bit_length((a < 0 ? -a : a) | b) <= wide_bits)
+			{
+				array &rn = scratch_num(), &rd = scratch_den();
+				rn.resize(size());
+				rd.resize(size());
+				frac_scale_kernel(n.data(), d.data(), a, b, rn.data(), rd.data(), size());
+				if (normalize(rn, rd))
+				{
+					n.swap(rn);
+					d.swap(rd);
+					return *this;
+				}
+			}
+			Frac<T> inv = c.inverse();
+			for (size_t i = 0; i < size(); i++)
+				set(i, (*this)[i] * inv);
+			return *this;
+		}
+
+		// subtract a scalar multiple of another vector
+		inline FracVector & sub_mul(const Frac<T> &c, const FracVector &y)
+		{
+			if (size() != y.size())
+				throw std::invalid_argument("Vector subtraction with different dimensions");
+			W a = c.neg ? -static_cast<W>(c.num) : static_cast<W>(c.num);
+			W b = static_cast<W>(c.den);
+			if (a == 0)
+				return *this;
+			if (bits() + y.bits() + bit_length((a < 0 ? -a : a) | b) <= wide_bits)
+			{
+				array &rn = scratch_num(), &rd = scratch_den();
+				rn.resize(size());
+				rd.resize(size());
+				frac_sub_mul_kernel(n.data(), d.data(), a, b, y.n.data(), y.d.data(), rn.data(), rd.data(), size());
+				if (normalize(rn, rd, y.n.data()))
+				{
+					n.swap(rn);
+					d.swap(rd);
+					return *this;
+				}
+			}
+			for (size_t i = 0; i < size(); i++)
+				if (y.n[i] != 0)
+					set(i, (*this)[i] - y[i] * c);
+			return *this;
+		}
+};
+
+// normalize the ratio n / d of 128 bit integers, d > 0, into a Frac<T>
+// reports false if the result does not fit in T
+template<typename T>
+inline bool frac_from_wide(__int128 n, __int128 d, Frac<T> &result)
+{
+	__int128 x = n < 0 ? -n : n, y = d;
+	while (y != 0)
+	{
+		__int128 t = x % y;
+		x = y;
+		y = t;
+	}
+	__int128 rn = (n < 0 ? -n : n) / x, rd = d / x;
+	if (rn > static_cast<__int128>(std::numeric_limits<T>::max()) || rd > static_cast<__int128>(std::numeric_limits<T>::max()))
+		return false;
+	result = Frac<T>(static_cast<T>(rn), static_cast<T>(rd), n < 0);
+	return true;
+}
+
+// gcd of |x| and y > 0 on 64 bits
+inline uint64_t frac_gcd(__int128 x, uint64_t y)
+{
+	unsigned __int128 m = x < 0 ? -static_cast<unsigned __int128>(x) : static_cast<unsigned __int128>(x);
+	return std::gcd(static_cast<uint64_t>(m >> 64 == 0 ? static_cast<uint64_t>(m) % y : m % y), y);
+}
+
+// sum of products of Frac<T> over a running common denominator
+// the partial sum is kept unnormalized, a 128 bit numerator over a 64 bit denominator,
+// reduced only when the denominator would overflow and once in get(); the gcds are
+// all of 64 bit integers
+template<typename T>
+struct dot_accumulator<Frac<T>>
+{
+	__int128 n;
+	uint64_t d;
+
+	inline dot_accumulator() : n(0), d(1) {}
+
+	inline bool add(const Frac<T> &a, const Frac<T> &b)
+	{
+		if (!frac_kernel<Frac<T>>::value)
+			return false;
+		uint64_t pn = static_cast<uint64_t>(a.num) * b.num, pd = static_cast<uint64_t>(a.den) * b.den;
+		if (pn == 0)
+			return true;
+		for (bool reduced = false; ; reduced = true)
+		{
+			// n / d + pn / pd over the least common denominator
+			uint64_t g = std::gcd(d, pd), l;
+			__int128 s, t;
+			if (!__builtin_mul_overflow(d / g, pd, &l)
+					&& !__builtin_mul_overflow(n, static_cast<__int128>(pd / g), &s)
+					&& !__builtin_mul_overflow(static_cast<__int128>(pn), static_cast<__int128>(d / g), &t)
+					&& !(a.neg != b.neg ? __builtin_sub_overflow(s, t, &s) : __builtin_add_overflow(s, t, &s)))
+			{
+				n = s;
+				d = l;
+				if (d <= static_cast<uint64_t>(std::numeric_limits<T>::max()))
+					return true;
+				// a sum over a denominator T can not hold rarely cancels back, give up early
+				uint64_t h = frac_gcd(n, d);
+				n /= h;
+				d /= h;
+				return d <= static_cast<uint64_t>(std::numeric_limits<T>::max());
+			}
+			if (reduced)
+				return false;
+			// reduce both terms and try once more
+			uint64_t h = frac_gcd(n, d), k = std::gcd(pn, pd);
+			if (h == 1 && k == 1)
+				return false;
+			n /= h;
+			d /= h;
+			pn /= k;
+			pd /= k;
+		}
+	}
+
+	inline bool get(Frac<T> &result) const
+	{
+		uint64_t g = frac_gcd(n, d);
+		__int128 rn = (n < 0 ? -n : n) / g;
+		uint64_t rd = d / g;
+		if (rn > static_cast<__int128>(std::numeric_limits<T>::max()) || rd > static_cast<uint64_t>(std::numeric_limits<T>::max()))
+			return false;
+		result = Frac<T>(static_cast<T>(rn), static_cast<T>(rd), n < 0);
+		return true;
+	}
+};
+
+// line reduce rows of Frac<T> into REF using the row kernels,
+// the rows of a pivot are updated in parallel by one team once large enough
+template<typename T>
+inline void frac_reduce_to_ref(std::vector<std::vector<Frac<T>>> &e, size_t aug, const TuningParams &p)
+{
+	if (e.empty())
+		return;
+	size_t cols = e.front().size();
+	std::vector<FracVector<T>> rows;
+	rows.reserve(e.size());
+	for (const std::vector<Frac<T>> &v : e)
+		rows.emplace_back(v);
+	WorkerTeam team(rows.size() * cols >= p.ref_parallel ? p.ref_threads : 1);
+	size_t leading = 0;
+	for (size_t j = 0; leading < rows.size() && j < cols - aug; j++)
+	{
+		if (rows[leading].is_zero(j))
+		{
+			for (size_t i = leading + 1; i < rows.size(); i++)
+				if (!rows[i].is_zero(j))
+				{
+					std::swap(rows[leading], rows[i]);
+					break;
+				}
+			if (rows[leading].is_zero(j))
+				continue;
+		}
+		rows[leading] /= rows[leading][j];
+		team.run(rows.size(), [&rows, leading, j](size_t i)
+			{
+				if (i != leading && !rows[i].is_zero(j))
+					rows[i].sub_mul(rows[i][j], rows[leading]);
+			});
+		leading++;
+	}
+	for (size_t i = 0; i < rows.size(); i++)
+		e[i] = rows[i];
+}
+
+// determinant of rows of Frac<T> by fraction-free elimination in 128 bit integers,
+// each row scaled to integers by the lcm of its denominators first, the rows below
+// a pivot are updated in parallel once large enough
+// throws std::overflow_error if an entry or the result leaves the range, rather than
+// the row kernels, whose scalar fallback overflows silently
+template<typename T>
+inline Frac<T> frac_det(const std::vector<std::vector<Frac<T>>> &e, const TuningParams &p)
+{
+	size_t n = e.size();
+	std::vector<__int128> a(n * n);
+	std::vector<uint64_t> L(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		uint64_t l = 1;
+		for (const Frac<T> &f : e[i])
+			if (__builtin_mul_overflow(l / std::gcd(l, static_cast<uint64_t>(f.den)), static_cast<uint64_t>(f.den), &l))
+				throw std::overflow_error("determinant row denominators exceed 64 bits");
+		L[i] = l;
+		for (size_t j = 0; j < n; j++)
+		{
+			const Frac<T> &f = e[i][j];
+			a[i * n + j] = static_cast<__int128>(f.num) * (l / f.den);
+			if (f.neg)
+				a[i * n + j] = -a[i * n + j];
+		}
+	}
+	WorkerTeam team(n * n >= p.ref_parallel ? p.ref_threads : 1);
+	__int128 prev = 1;
+	bool negate = false;
+	for (size_t k = 0; k < n; k++)
+	{
+		size_t i = k;
+		while (i < n && a[i * n + k] == 0)
+			i++;
+		if (i == n)
+			return Frac<T>(0);
+		if (i != k)
+		{
+			std::swap_ranges(a.begin() + i * n, a.begin() + (i + 1) * n, a.begin() + k * n);
+			negate = !negate;
+		}
+		std::atomic<bool> fits(true);
+		team.run(n - k - 1, [&a, &fits, n, k, prev](size_t r)
+			{
+				__int128 *ri = &a[(k + 1 + r) * n], *rk = &a[k * n];
+				for (size_t j = k + 1; j < n; j++)
+				{
+					// exact division by the previous pivot
+					__int128 x, y;
+					if (__builtin_mul_overflow(ri[j], rk[k], &x) || __builtin_mul_overflow(ri[k], rk[j], &y)
+							|| __builtin_sub_overflow(x, y, &x))
+					{
+						fits = false;
+						return;
+					}
+					ri[j] = x / prev;
+				}
+			});
+		if (!fits)
+			throw std::overflow_error("fraction-free elimination exceeds 128 bits");
+		prev = a[k * n + k];
+	}
+	// det = last pivot / prod L
+	__int128 num = negate ? -prev : prev, den = 1;
+	Frac<T> result;
+	for (uint64_t l : L)
+	{
+		uint64_t g = frac_gcd(num, l);
+		num /= g;
+		if (__builtin_mul_overflow(den, static_cast<__int128>(l / g), &den))
+			throw std::overflow_error("determinant out of range");
+	}
+	if (!frac_from_wide(num, den, result))
+		throw std::overflow_error("determinant out of range");
+	return result;
+}
+
+#endif
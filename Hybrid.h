@@ -0,0 +1,309 @@
+
+#ifndef _HYBRID_H_
+#define _HYBRID_H_
+
+#include <stdexcept>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include "Vector.h"
+#include "Matrix.h"
+#include "FracVector.h"
+
+// LU decomposition with partial pivoting of a row-major array of doubles
+// the elimination loops run over contiguous aligned rows so they vectorize
+class DoubleLU
+{
+	private:
+		size_t m, n;
+		std::vector<double, aligned_allocator<double>> a;
+		std::vector<size_t> p;
+		bool odd;
+
+		inline double * row(size_t i) {return a.data() + i * n;}
+		inline const double * row(size_t i) const {return a.data() + i * n;}
+
+	public:
+		inline DoubleLU(const double *data, size_t rows, size_t cols) : m(rows), n(cols), a(data, data + rows * cols), p(rows), odd(false)
+		{
+			std::iota(p.begin(), p.end(), 0);
+			for (size_t k = 0; k < std::min(m, n); k++)
+			{
+				size_t piv = k;
+				for (size_t i = k + 1; i < m; i++)
+					if (std::fabs(row(i)[k]) > std::fabs(row(piv)[k]))
+						piv = i;
+				if (piv != k)
+				{
+					std::swap_ranges(row(k), row(k) + n, row(piv));
+					std::swap(p[k], p[piv]);
+					odd = !odd;
+				}
+				const double *s = row(k);
+				if (s[k] == 0)
+					continue;
+				for (size_t i = k + 1; i < m; i++)
+				{
+					double *r = row(i);
+					double l = r[k] /= s[k];
+					if (l != 0)
+						for (size_t j = k + 1; j < n; j++)
+							r[j] -= l * s[j];
+				}
+			}
+		}
+
+		// index in the original matrix of the i-th pivot row
+		inline size_t perm(size_t i) const {return p[i];}
+
+		// certified determinant of a square matrix of integers
+		// data is the decomposed matrix, the error of the floating point determinant is
+		// bounded by the Hadamard perturbation bound prod(|b_i| + |e_i|) - prod |b_i|
+		// on the backward error |E| <= gamma_n |L||U|, plus the rounding of the product
+		inline bool certified_det(const double *data, int64_t &D) const
+		{
+			if (m != n)
+				throw std::invalid_argument("determinant of non-square Matrix");
+			const double u = std::numeric_limits<double>::epsilon() / 2;
+			const double gamma = n * u / (1 - n * u);
+			std::vector<double> unorm(n);
+			double d = odd ? -1 : 1;
+			for (size_t k = 0; k < n; k++)
+			{
+				double s = 0;
+				for (size_t j = k; j < n; j++)
+					s += row(k)[j] * row(k)[j];
+				unorm[k] = std::sqrt(s);
+				d *= row(k)[k];
+			}
+			double logh = 0, rel = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				const double *b = data + p[i] * n;
+				double h = 0;
+				for (size_t j = 0; j < n; j++)
+					h += b[j] * b[j];
+				h = std::sqrt(h);
+				if (h == 0)
+				{
+					D = 0;
+					return true;
+				}
+				double err = unorm[i];
+				for (size_t k = 0; k < i; k++)
+					err += std::fabs(row(i)[k]) * unorm[k];
+				logh += std::log(h);
+				rel += std::log1p(gamma * err / h);
+			}
+			double bound = std::exp(logh) * std::expm1(rel) + gamma * std::fabs(d) / (1 - gamma);
+			// slack for the rounding of the bound itself
+			bound *= 1 + 1e-6;
+			if (!(bound < 0.5) || !(std::fabs(d) < 0x1p62))
+				return false;
+			D = std::llround(d);
+			return true;
+		}
+
+		// solve in place for a square matrix
+		inline void solve(std::vector<double> &x) const
+		{
+			std::vector<double> y(n);
+			for (size_t i = 0; i < n; i++)
+			{
+				y[i] = x[p[i]];
+				for (size_t k = 0; k < i; k++)
+					y[i] -= row(i)[k] * y[k];
+			}
+			for (size_t i = n; i-- > 0;)
+			{
+				for (size_t k = i + 1; k < n; k++)
+					y[i] -= row(i)[k] * y[k];
+				y[i] /= row(i)[i];
+			}
+			x = std::move(y);
+		}
+};
+
+// scale each row of A by the lcm of its denominators into integers
+// exactly representable as doubles, reports false if they are not
+template<typename T>
+inline bool scale_rows(const Matrix<Frac<T>> &A, std::vector<double> &B, std::vector<uint64_t> &L)
+{
+	const uint64_t limit = uint64_t(1) << std::numeric_limits<double>::digits;
+	B.resize(A.row() * A.col());
+	L.resize(A.row());
+	for (size_t i = 0; i < A.row(); i++)
+	{
+		uint64_t l = 1;
+		for (size_t j = 0; j < A.col(); j++)
+		{
+			uint64_t d = A.get(i, j).den;
+			if (__builtin_mul_overflow(l / std::gcd(l, d), d, &l) || l > limit)
+				return false;
+		}
+		L[i] = l;
+		for (size_t j = 0; j < A.col(); j++)
+		{
+			const Frac<T> &f = A.get(i, j);
+			uint64_t v;
+			if (__builtin_mul_overflow(static_cast<uint64_t>(f.num), l / f.den, &v) || v > limit)
+				return false;
+			B[i * A.col() + j] = f.neg ? -static_cast<double>(v) : static_cast<double>(v);
+		}
+	}
+	return true;
+}
+
+// determinant computed in floating point and certified exact,
+// falling back to the exact path when the certificate fails
+template<typename T>
+inline Frac<T> hybrid_det(const Matrix<Frac<T>> &A, bool *certified = nullptr)
+{
+	if (A.row() != A.col())
+		throw std::invalid_argument("determinant of non-square Matrix");
+	size_t n = A.row();
+	std::vector<double> B;
+	std::vector<uint64_t> L;
+	int64_t D;
+	if (n > 0 && scale_rows(A, B, L) && DoubleLU(B.data(), n, n).certified_det(B.data(), D))
+	{
+		// det(A) = D / prod L
+		__int128 num = D, den = 1;
+		bool fits = true;
+		for (uint64_t l : L)
+		{
+			__int128 g = std::gcd(static_cast<uint64_t>(num < 0 ? -num : num), l);
+			num /= g;
+			if (__builtin_mul_overflow(den, static_cast<__int128>(l) / g, &den))
+			{
+				fits = false;
+				break;
+			}
+		}
+		Frac<T> result;
+		if (fits && frac_from_wide(num, den, result))
+		{
+			if (certified != nullptr)
+				*certified = true;
+			return result;
+		}
+	}
+	if (certified != nullptr)
+		*certified = false;
+	return A.det();
+}
+
+// rank computed in floating point and certified by a nonzero maximal minor,
+// falling back to the exact path when the matrix is not certified to be of full rank
+template<typename T>
+inline size_t hybrid_rank(const Matrix<Frac<T>> &A, bool *certified = nullptr)
+{
+	size_t m = A.row(), n = A.col(), r = std::min(m, n);
+	std::vector<double> B;
+	std::vector<uint64_t> L;
+	if (r > 0 && scale_rows(A, B, L))
+	{
+		// pick the minor rows from the tall orientation of the matrix
+		if (m < n)
+		{
+			std::vector<double> Bt(n * m);
+			for (size_t i = 0; i < m; i++)
+				for (size_t j = 0; j < n; j++)
+					Bt[j * m + i] = B[i * n + j];
+			B = std::move(Bt);
+			std::swap(m, n);
+		}
+		DoubleLU lu(B.data(), m, n);
+		std::vector<double> M(r * r);
+		for (size_t i = 0; i < r; i++)
+			std::copy(B.begin() + lu.perm(i) * n, B.begin() + (lu.perm(i) + 1) * n, M.begin() + i * r);
+		int64_t D;
+		if (DoubleLU(M.data(), r, r).certified_det(M.data(), D) && D != 0)
+		{
+			if (certified != nullptr)
+				*certified = true;
+			return r;
+		}
+	}
+	if (certified != nullptr)
+		*certified = false;
+	return A.rank();
+}
+
+// solution of a square system computed in floating point and certified by
+// rounding D x to integers, D the certified determinant, and verifying the
+// residual exactly, falling back to the exact path when either step fails
+template<typename T, bool C>
+inline Vector<Frac<T>> hybrid_solve(const Matrix<Frac<T>> &A, const Vector<Frac<T>, C> &b, bool *certified = nullptr)
+{
+	if (b.size() != A.row())
+		throw std::invalid_argument("linear system with incompatible dimensions");
+	size_t n = A.row();
+	if (n > 0 && n == A.col())
+	{
+		Matrix<Frac<T>> R(n, n + 1);
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t j = 0; j < n; j++)
+				R.get(i, j) = A.get(i, j);
+			R.get(i, n) = b[i];
+		}
+		std::vector<double> S, B(n * n), c(n);
+		std::vector<uint64_t> L;
+		int64_t D;
+		if (scale_rows(R, S, L))
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				std::copy(S.begin() + i * (n + 1), S.begin() + i * (n + 1) + n, B.begin() + i * n);
+				c[i] = S[i * (n + 1) + n];
+			}
+			DoubleLU lu(B.data(), n, n);
+			if (lu.certified_det(B.data(), D) && D != 0)
+			{
+				std::vector<double> x(c);
+				lu.solve(x);
+				std::vector<int64_t> Y(n);
+				bool exact = true;
+				for (size_t j = 0; exact && j < n; j++)
+				{
+					double y = static_cast<double>(D) * x[j];
+					if (!(std::fabs(y) < 0x1p62))
+						exact = false;
+					else
+						Y[j] = std::llround(y);
+				}
+				// verify B Y = D c exactly
+				for (size_t i = 0; exact && i < n; i++)
+				{
+					__int128 s = 0, t;
+					for (size_t j = 0; exact && j < n; j++)
+						if (__builtin_mul_overflow(static_cast<__int128>(static_cast<int64_t>(B[i * n + j])), static_cast<__int128>(Y[j]), &t)
+								|| __builtin_add_overflow(s, t, &s))
+							exact = false;
+					if (exact && s != static_cast<__int128>(D) * static_cast<__int128>(static_cast<int64_t>(c[i])))
+						exact = false;
+				}
+				Vector<Frac<T>> result(n);
+				__int128 den = D < 0 ? -static_cast<__int128>(D) : static_cast<__int128>(D);
+				for (size_t j = 0; exact && j < n; j++)
+					exact = frac_from_wide(D < 0 ? -static_cast<__int128>(Y[j]) : static_cast<__int128>(Y[j]), den, result[j]);
+				if (exact)
+				{
+					if (certified != nullptr)
+						*certified = true;
+					return result;
+				}
+			}
+		}
+	}
+	if (certified != nullptr)
+		*certified = false;
+	return A.solve(b);
+}
+
+#endif
@@ -0,0 +1,412 @@
+
+#ifndef _INTMATRIX_H_
+#define _INTMATRIX_H_
+
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include "Frac.h"
+#include "Matrix.h"
+
+// conversions between entries of T and integers
+template<typename T>
+struct int_entry
+{
+	// value of an integral entry, false if it is not an integer of 64 bits
+	static inline bool get(const T &x, int64_t &v)
+	{
+		if constexpr (std::is_integral<T>::value)
+		{
+			if (std::is_unsigned<T>::value && static_cast<uint64_t>(x) > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+				return false;
+			v = static_cast<int64_t>(x);
+			return true;
+		}
+		else if constexpr (std::is_floating_point<T>::value)
+		{
+			if (x != std::trunc(x) || std::fabs(x) >= 9.2e18)
+				return false;
+			v = static_cast<int64_t>(x);
+			return true;
+		}
+		else
+			return false;
+	}
+
+	// check if an integer is representable
+	static inline bool fits(int64_t v)
+	{
+		if constexpr (std::is_integral<T>::value)
+			return v >= static_cast<int64_t>(std::numeric_limits<T>::min())
+				&& static_cast<uint64_t>(v < 0 ? 0 : v) <= static_cast<uint64_t>(std::numeric_limits<T>::max());
+		else
+			return true;
+	}
+
+	static inline T make(int64_t v) {return static_cast<T>(v);}
+};
+
+template<typename U>
+struct int_entry<Frac<U>>
+{
+	static inline bool get(const Frac<U> &x, int64_t &v)
+	{
+		if (x.den != 1 || static_cast<uint64_t>(x.num) > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+			return false;
+		v = x.neg ? -static_cast<int64_t>(x.num) : static_cast<int64_t>(x.num);
+		return true;
+	}
+
+	static inline bool fits(int64_t v)
+	{
+		uint64_t m = v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v);
+		return m <= static_cast<uint64_t>(std::numeric_limits<U>::max());
+	}
+
+	static inline Frac<U> make(int64_t v)
+	{
+		uint64_t m = v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v);
+		return Frac<U>(static_cast<U>(m), 1, v < 0);
+	}
+};
+
+// integer matrix stored in the narrowest of 8, 16, 32 and 64 bit entries that holds it,
+// operations pick the width of their result from bounds on its entries and
+// elimination widens the matrix when an entry would overflow
+class IntMatrix
+{
+	public:
+		typedef std::variant<std::vector<int8_t>, std::vector<int16_t>, std::vector<int32_t>, std::vector<int64_t>> storage_t;
+
+	private:
+		size_t rows, cols;
+		// row-major
+		storage_t data;
+
+		// index into storage_t of the narrowest entries of magnitude up to bound
+		static inline size_t width_for(unsigned __int128 bound)
+		{
+			if (bound <= static_cast<unsigned __int128>(std::numeric_limits<int8_t>::max()))
+				return 0;
+			if (bound <= static_cast<unsigned __int128>(std::numeric_limits<int16_t>::max()))
+				return 1;
+			if (bound <= static_cast<unsigned __int128>(std::numeric_limits<int32_t>::max()))
+				return 2;
+			if (bound <= static_cast<unsigned __int128>(std::numeric_limits<int64_t>::max()))
+				return 3;
+			throw std::overflow_error("integer matrix entries exceed 64 bits");
+		}
+
+		static inline storage_t make_storage(size_t width, size_t n)
+		{
+			switch (width)
+			{
+				case 0: return std::vector<int8_t>(n);
+				case 1: return std::vector<int16_t>(n);
+				case 2: return std::vector<int32_t>(n);
+				default: return std::vector<int64_t>(n);
+			}
+		}
+
+		// state of a fraction-free elimination, kept to resume it after widening
+		struct bareiss_state
+		{
+			size_t k, c, i, j;
+			int64_t prev;
+			bool negate;
+		};
+
+		// Bareiss elimination from the state, returns false with the state at the
+		// entry that does not fit in S
+		template<typename S>
+		inline bool bareiss_kernel(std::vector<S> &a, bareiss_state &st)
+		{
+			// narrow entries multiply without overflow in 64 bits
+			typedef typename std::conditional<sizeof(S) <= 2, int64_t, __int128>::type W;
+			while (st.k < rows && st.c < cols)
+			{
+				// i is past k while a pivot is being applied
+				if (st.i == 0)
+				{
+					size_t p = st.k;
+					while (p < rows && a[p * cols + st.c] == 0)
+						p++;
+					if (p == rows)
+					{
+						st.c++;
+						continue;
+					}
+					if (p != st.k)
+					{
+						std::swap_ranges(a.begin() + p * cols, a.begin() + (p + 1) * cols, a.begin() + st.k * cols);
+						st.negate = !st.negate;
+					}
+					st.i = st.k + 1;
+					st.j = st.c + 1;
+				}
+				const S *rk = &a[st.k * cols];
+				W pivot = rk[st.c], prev = st.prev;
+				for (; st.i < rows; st.i++, st.j = st.c + 1)
+				{
+					S *ri = &a[st.i * cols];
+					// cleared once the row is done, so a resumed row still sees it
+					W m = ri[st.c];
+					for (; st.j < cols; st.j++)
+					{
+						W v = (ri[st.j] * pivot - m * rk[st.j]) / prev;
+						if (v < std::numeric_limits<S>::min() || v > std::numeric_limits<S>::max())
+							return false;
+						ri[st.j] = static_cast<S>(v);
+					}
+					ri[st.c] = 0;
+				}
+				st.prev = static_cast<int64_t>(pivot);
+				st.k++;
+				st.c++;
+				st.i = 0;
+			}
+			return true;
+		}
+
+		// bound on the entries of this times A: the largest absolute row sum of this
+		// times the largest entry of A
+		inline unsigned __int128 product_bound(const IntMatrix &A) const
+		{
+			unsigned __int128 row_sum = 0;
+			std::visit([this, &row_sum](const auto &a)
+				{
+					for (size_t i = 0; i < rows; i++)
+					{
+						unsigned __int128 s = 0;
+						for (size_t k = 0; k < cols; k++)
+						{
+							int64_t x = a[i * cols + k];
+							s += x < 0 ? 0 - static_cast<uint64_t>(x) : static_cast<uint64_t>(x);
+						}
+						if (s > row_sum)
+							row_sum = s;
+					}
+				}, data);
+			return row_sum * A.max_abs();
+		}
+
+	public:
+		// zero matrix
+		inline IntMatrix(size_t r = 0, size_t c = 0, size_t width = 0) : rows(r), cols(c), data(make_storage(width, r * c)) {}
+
+		// dimensions
+		inline size_t row() const {return rows;}
+		inline size_t col() const {return cols;}
+
+		// bytes per entry and in total
+		inline size_t width() const {return std::visit([](const auto &a) {return sizeof(a[0]);}, data);}
+		inline size_t bytes() const {return width() * rows * cols;}
+
+		// get an entry
+		inline int64_t get(size_t r, size_t c) const
+		{
+			return std::visit([this, r, c](const auto &a) {return static_cast<int64_t>(a[r * cols + c]);}, data);
+		}
+
+		// set an entry, widening the matrix if needed
+		inline IntMatrix & set(size_t r, size_t c, int64_t v)
+		{
+			uint64_t m = v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v);
+			if (width_for(m) > data.index())
+				widen(width_for(m));
+			std::visit([this, r, c, v](auto &a) {a[r * cols + c] = static_cast<typename std::decay<decltype(a[0])>::type>(v);}, data);
+			return *this;
+		}
+
+		// largest absolute value of the entries
+		inline uint64_t max_abs() const
+		{
+			return std::visit([](const auto &a)
+				{
+					uint64_t m = 0;
+					for (auto x : a)
+					{
+						uint64_t v = x < 0 ? 0 - static_cast<uint64_t>(x) : static_cast<uint64_t>(x);
+						if (v > m)
+							m = v;
+					}
+					return m;
+				}, data);
+		}
+
+		// change the width of the entries, to index into storage_t
+		inline IntMatrix & widen(size_t width)
+		{
+			storage_t wider = make_storage(width, rows * cols);
+			std::visit([](const auto &from, auto &to)
+				{
+					for (size_t i = 0; i < from.size(); i++)
+						to[i] = static_cast<typename std::decay<decltype(to[0])>::type>(from[i]);
+				}, data, wider);
+			data = std::move(wider);
+			return *this;
+		}
+
+		// narrow the entries as far as they fit
+		inline IntMatrix & shrink()
+		{
+			size_t width = width_for(max_abs());
+			if (width < data.index())
+				widen(width);
+			return *this;
+		}
+
+		// convert a matrix with integral entries, false if some entry is not
+		template<typename T>
+		static inline bool from_matrix(const Matrix<T> &A, IntMatrix &result)
+		{
+			std::vector<int64_t> v(A.row() * A.col());
+			uint64_t m = 0;
+			for (size_t i = 0; i < A.row(); i++)
+				for (size_t j = 0; j < A.col(); j++)
+				{
+					int64_t &x = v[i * A.col() + j];
+					if (!int_entry<T>::get(A.get(i, j), x))
+						return false;
+					uint64_t a = x < 0 ? 0 - static_cast<uint64_t>(x) : static_cast<uint64_t>(x);
+					if (a > m)
+						m = a;
+				}
+			result = IntMatrix(A.row(), A.col(), width_for(m));
+			std::visit([&v](auto &a)
+				{
+					for (size_t i = 0; i < v.size(); i++)
+						a[i] = static_cast<typename std::decay<decltype(a[0])>::type>(v[i]);
+				}, result.data);
+			return true;
+		}
+
+		// convert to a matrix of T, false if some entry does not fit in T
+		template<typename T>
+		inline bool to_matrix(Matrix<T> &result) const
+		{
+			Matrix<T> R(rows, cols);
+			bool exact = std::visit([this, &R](const auto &a)
+				{
+					for (size_t i = 0; i < rows; i++)
+						for (size_t j = 0; j < cols; j++)
+						{
+							int64_t x = a[i * cols + j];
+							if (!int_entry<T>::fits(x))
+								return false;
+							R.get(i, j) = int_entry<T>::make(x);
+						}
+					return true;
+				}, data);
+			if (exact)
+				result.swap(R);
+			return exact;
+		}
+
+		// matrix addition and subtraction
+		inline IntMatrix operator+(const IntMatrix &A) const
+		{
+			if (rows != A.rows || cols != A.cols)
+				throw std::invalid_argument("matrix addition with incompatible dimensions");
+			IntMatrix R(rows, cols, width_for(static_cast<unsigned __int128>(max_abs()) + A.max_abs()));
+			std::visit([](const auto &a, const auto &b, auto &r)
+				{
+					typedef typename std::decay<decltype(r[0])>::type S;
+					for (size_t i = 0; i < r.size(); i++)
+						r[i] = static_cast<S>(static_cast<S>(a[i]) + static_cast<S>(b[i]));
+				}, data, A.data, R.data);
+			return R;
+		}
+		inline IntMatrix operator-(const IntMatrix &A) const
+		{
+			if (rows != A.rows || cols != A.cols)
+				throw std::invalid_argument("matrix subtraction with incompatible dimensions");
+			IntMatrix R(rows, cols, width_for(static_cast<unsigned __int128>(max_abs()) + A.max_abs()));
+			std::visit([](const auto &a, const auto &b, auto &r)
+				{
+					typedef typename std::decay<decltype(r[0])>::type S;
+					for (size_t i = 0; i < r.size(); i++)
+						r[i] = static_cast<S>(static_cast<S>(a[i]) - static_cast<S>(b[i]));
+				}, data, A.data, R.data);
+			return R;
+		}
+
+		// matrix multiplication, accumulating rows in the width of the result
+		inline IntMatrix operator*(const IntMatrix &A) const
+		{
+			if (cols != A.rows)
+				throw std::invalid_argument("matrix multiplication with incompatible dimensions");
+			IntMatrix R(rows, A.cols, width_for(product_bound(A)));
+			size_t l = rows, n = cols, m = A.cols;
+			std::visit([l, n, m](const auto &a, const auto &b, auto &r)
+				{
+					typedef typename std::decay<decltype(r[0])>::type S;
+					for (size_t i = 0; i < l; i++)
+					{
+						S *ri = &r[i * m];
+						for (size_t k = 0; k < n; k++)
+						{
+							S x = static_cast<S>(a[i * n + k]);
+							if (x == 0)
+								continue;
+							const auto *bk = &b[k * m];
+							for (size_t j = 0; j < m; j++)
+								ri[j] = static_cast<S>(ri[j] + x * static_cast<S>(bk[j]));
+						}
+					}
+				}, data, A.data, R.data);
+			return R;
+		}
+
+		// fraction-free elimination into row echelon form, widening as entries grow,
+		// returns the rank and sets det for square matrices
+		// throws std::overflow_error if an entry exceeds 64 bits
+		inline size_t bareiss(int64_t *det = nullptr)
+		{
+			bareiss_state st{0, 0, 0, 0, 1, false};
+			while (!std::visit([this, &st](auto &a) {return bareiss_kernel(a, st);}, data))
+			{
+				if (data.index() == 3)
+					throw std::overflow_error("integer elimination exceeds 64 bits");
+				widen(data.index() + 1);
+			}
+			if (det != nullptr && rows == cols)
+			{
+				*det = st.k < rows ? 0 : rows == 0 ? 1 : get(rows - 1, cols - 1);
+				if (st.negate)
+					*det = -*det;
+			}
+			return st.k;
+		}
+};
+
+// product of a chain of integer matrices in the cheapest order
+inline IntMatrix int_chain_product(const std::vector<const IntMatrix *> &factors, const std::vector<std::vector<size_t>> &split, size_t i, size_t j)
+{
+	if (i == j)
+		return *factors[i];
+	size_t k = split[i][j];
+	return int_chain_product(factors, split, i, k) * int_chain_product(factors, split, k + 1, j);
+}
+
+inline IntMatrix int_chain_product(const std::vector<const IntMatrix *> &factors)
+{
+	if (factors.empty())
+		throw std::invalid_argument("product of no matrices");
+	std::vector<size_t> dims{factors[0]->row()};
+	for (const IntMatrix *A : factors)
+	{
+		if (A->row() != dims.back())
+			throw std::invalid_argument("matrix multiplication with incompatible dimensions");
+		dims.push_back(A->col());
+	}
+	return int_chain_product(factors, chain_order(dims), 0, factors.size() - 1);
+}
+
+#endif
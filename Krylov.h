@@ -0,0 +1,519 @@
+
+#ifndef _KRYLOV_H_
+#define _KRYLOV_H_
+
+#include <stdexcept>
+#include <vector>
+#include <tuple>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+#include "Vector.h"
+#include "Matrix.h"
+
+// square linear operator y = A x, all that the Krylov solvers need of a system
+template<typename T>
+class LinearOperator
+{
+	public:
+		virtual ~LinearOperator() {}
+		virtual size_t size() const = 0;
+		virtual void apply(const std::vector<T> &x, std::vector<T> &y) const = 0;
+};
+
+// a Matrix, or any square M with row(), col() and a matrix-vector operator*
+template<typename T, typename M = Matrix<T>>
+class MatrixOperator : public LinearOperator<T>
+{
+	private:
+		const M &A;
+
+	public:
+		inline MatrixOperator(const M &matrix) : A(matrix)
+		{
+			if (A.row() != A.col())
+				throw std::invalid_argument("linear operator of a non-square Matrix");
+		}
+
+		inline size_t size() const {return A.row();}
+
+		inline void apply(const std::vector<T> &x, std::vector<T> &y) const
+		{
+			std::vector<T> in(x);
+			Vector<T> out = A * Vector<T>(in);
+			y.resize(out.size());
+			for (size_t i = 0; i < out.size(); i++)
+				y[i] = out[i];
+		}
+};
+
+// operator given by a function, e.g. a matrix-free discretization
+template<typename T>
+class FunctionOperator : public LinearOperator<T>
+{
+	private:
+		size_t n;
+		std::function<void(const std::vector<T> &, std::vector<T> &)> f;
+
+	public:
+		inline FunctionOperator(size_t size, std::function<void(const std::vector<T> &, std::vector<T> &)> apply)
+			: n(size), f(std::move(apply)) {}
+
+		inline size_t size() const {return n;}
+
+		inline void apply(const std::vector<T> &x, std::vector<T> &y) const
+		{
+			y.resize(n);
+			f(x, y);
+		}
+};
+
+// square matrix in compressed sparse rows, columns sorted within each row
+template<typename T>
+class SparseMatrix : public LinearOperator<T>
+{
+	private:
+		size_t n;
+		std::vector<size_t> start, column;
+		std::vector<T> value;
+
+	public:
+		// nonzero entries of a dense matrix
+		template<typename U>
+		inline explicit SparseMatrix(const Matrix<U> &A) : n(A.row()), start{0}
+		{
+			if (A.row() != A.col())
+				throw std::invalid_argument("sparse matrix of a non-square Matrix");
+			for (size_t i = 0; i < n; i++)
+			{
+				for (size_t j = 0; j < n; j++)
+				{
+					T x = static_cast<T>(A.get(i, j));
+					if (x != static_cast<T>(0))
+					{
+						column.push_back(j);
+						value.push_back(x);
+					}
+				}
+				start.push_back(column.size());
+			}
+		}
+
+		// (row, column, value) entries in any order, repeated entries are summed
+		inline SparseMatrix(size_t size, std::vector<std::tuple<size_t, size_t, T>> entries) : n(size), start(size + 1, 0)
+		{
+			std::sort(entries.begin(), entries.end(),
+				[](const std::tuple<size_t, size_t, T> &a, const std::tuple<size_t, size_t, T> &b)
+				{
+					return std::get<0>(a) != std::get<0>(b) ? std::get<0>(a) < std::get<0>(b) : std::get<1>(a) < std::get<1>(b);
+				});
+			for (size_t k = 0; k < entries.size(); k++)
+			{
+				size_t i = std::get<0>(entries[k]), j = std::get<1>(entries[k]);
+				if (i >= n || j >= n)
+					throw std::invalid_argument("sparse matrix entry out of range");
+				if (k != 0 && i == std::get<0>(entries[k - 1]) && j == std::get<1>(entries[k - 1]))
+					value.back() += std::get<2>(entries[k]);
+				else
+				{
+					column.push_back(j);
+					value.push_back(std::get<2>(entries[k]));
+					start[i + 1]++;
+				}
+			}
+			for (size_t i = 0; i < n; i++)
+				start[i + 1] += start[i];
+		}
+
+		inline size_t size() const {return n;}
+		inline size_t nonzeros() const {return value.size();}
+
+		// entries of row i are [row_begin(i), row_end(i)) of columns() and values()
+		inline size_t row_begin(size_t i) const {return start[i];}
+		inline size_t row_end(size_t i) const {return start[i + 1];}
+		inline const std::vector<size_t> & columns() const {return column;}
+		inline const std::vector<T> & values() const {return value;}
+
+		inline T diagonal(size_t i) const
+		{
+			std::vector<size_t>::const_iterator first = column.begin() + start[i], last = column.begin() + start[i + 1];
+			std::vector<size_t>::const_iterator it = std::lower_bound(first, last, i);
+			return it != last && *it == i ? value[it - column.begin()] : static_cast<T>(0);
+		}
+
+		inline void apply(const std::vector<T> &x, std::vector<T> &y) const
+		{
+			if (x.size() != n)
+				throw std::invalid_argument("linear transformation with incompatible dimensions");
+			y.resize(n);
+			for (size_t i = 0; i < n; i++)
+			{
+				T sum = static_cast<T>(0);
+				for (size_t k = start[i]; k < start[i + 1]; k++)
+					sum += value[k] * x[column[k]];
+				y[i] = sum;
+			}
+		}
+};
+
+// z = M^-1 r for an approximation M of the system
+template<typename T>
+class Preconditioner
+{
+	public:
+		virtual ~Preconditioner() {}
+		virtual void apply(const std::vector<T> &r, std::vector<T> &z) const = 0;
+};
+
+template<typename T>
+class IdentityPreconditioner : public Preconditioner<T>
+{
+	public:
+		inline void apply(const std::vector<T> &r, std::vector<T> &z) const {z = r;}
+};
+
+// M = diag(A)
+template<typename T>
+class JacobiPreconditioner : public Preconditioner<T>
+{
+	private:
+		std::vector<T> inverse;
+
+	public:
+		inline JacobiPreconditioner(const SparseMatrix<T> &A) : inverse(A.size())
+		{
+			for (size_t i = 0; i < A.size(); i++)
+			{
+				T d = A.diagonal(i);
+				if (d == static_cast<T>(0))
+					throw std::invalid_argument("Jacobi preconditioner of a matrix with a zero diagonal entry");
+				inverse[i] = static_cast<T>(1) / d;
+			}
+		}
+
+		inline void apply(const std::vector<T> &r, std::vector<T> &z) const
+		{
+			z.resize(r.size());
+			for (size_t i = 0; i < r.size(); i++)
+				z[i] = inverse[i] * r[i];
+		}
+};
+
+// M = L U, the factors of A restricted to the nonzero pattern of A
+template<typename T>
+class ILU0Preconditioner : public Preconditioner<T>
+{
+	private:
+		size_t n;
+		std::vector<size_t> start, column, diag;
+		std::vector<T> value;
+
+	public:
+		inline ILU0Preconditioner(const SparseMatrix<T> &A)
+			: n(A.size()), start(n + 1), column(A.columns()), diag(n), value(A.values())
+		{
+			const size_t none = std::numeric_limits<size_t>::max();
+			for (size_t i = 0; i <= n; i++)
+				start[i] = i < n ? A.row_begin(i) : A.nonzeros();
+			// position of each column in the row being factored
+			std::vector<size_t> where(n, none);
+			for (size_t i = 0; i < n; i++)
+			{
+				for (size_t k = start[i]; k < start[i + 1]; k++)
+					where[column[k]] = k;
+				size_t k;
+				for (k = start[i]; k < start[i + 1] && column[k] < i; k++)
+				{
+					size_t j = column[k];
+					value[k] /= value[diag[j]];
+					for (size_t l = diag[j] + 1; l < start[j + 1]; l++)
+						if (where[column[l]] != none)
+							value[where[column[l]]] -= value[k] * value[l];
+				}
+				if (k == start[i + 1] || column[k] != i || value[k] == static_cast<T>(0))
+					throw std::invalid_argument("incomplete LU of a matrix with a zero pivot");
+				diag[i] = k;
+				for (k = start[i]; k < start[i + 1]; k++)
+					where[column[k]] = none;
+			}
+		}
+
+		inline void apply(const std::vector<T> &r, std::vector<T> &z) const
+		{
+			z = r;
+			// L has a unit diagonal
+			for (size_t i = 0; i < n; i++)
+				for (size_t k = start[i]; k < diag[i]; k++)
+					z[i] -= value[k] * z[column[k]];
+			for (size_t i = n; i-- > 0;)
+			{
+				for (size_t k = diag[i] + 1; k < start[i + 1]; k++)
+					z[i] -= value[k] * z[column[k]];
+				z[i] /= value[diag[i]];
+			}
+		}
+};
+
+// stopping rule of the iterations
+struct SolverOptions
+{
+	// relative residual |b - A x| / |b| to reach
+	double tol;
+	// matrix-vector products allowed
+	size_t max_iter;
+	// Krylov dimension before GMRES restarts
+	size_t restart;
+	// called with the iteration and the relative residual after each iteration
+	std::function<void(size_t, double)> monitor;
+};
+
+inline SolverOptions default_solver_options()
+{
+	return SolverOptions{1e-10, 1000, 30, nullptr};
+}
+
+// outcome of a solve, the residual recomputed from the final x
+struct SolverReport
+{
+	bool converged;
+	size_t iterations;
+	double residual;
+};
+
+template<typename T>
+inline T vector_norm(const std::vector<T> &x)
+{
+	return std::sqrt(dot_product<T>(x.begin(), x.end(), x.begin()));
+}
+
+// r = b - A x, x resized to a zero initial guess if it is not of the size of b
+template<typename T>
+inline void krylov_residual(const LinearOperator<T> &A, const std::vector<T> &b, std::vector<T> &x, std::vector<T> &r)
+{
+	if (b.size() != A.size())
+		throw std::invalid_argument("linear system with incompatible dimensions");
+	if (x.size() != b.size())
+		x.assign(b.size(), static_cast<T>(0));
+	A.apply(x, r);
+	for (size_t i = 0; i < r.size(); i++)
+		r[i] = b[i] - r[i];
+}
+
+template<typename T>
+inline SolverReport krylov_report(const LinearOperator<T> &A, const std::vector<T> &b, std::vector<T> &x, bool converged, size_t iterations)
+{
+	std::vector<T> r;
+	krylov_residual(A, b, x, r);
+	T scale = vector_norm(b);
+	return SolverReport{converged, iterations, static_cast<double>(scale == static_cast<T>(0) ? vector_norm(r) : vector_norm(r) / scale)};
+}
+
+// conjugate gradients, for symmetric positive definite A and M
+template<typename T>
+inline SolverReport cg(const LinearOperator<T> &A, const std::vector<T> &b, std::vector<T> &x, const Preconditioner<T> &M, const SolverOptions &opt = default_solver_options())
+{
+	std::vector<T> r, z, p, q;
+	krylov_residual(A, b, x, r);
+	T scale = vector_norm(b);
+	if (scale == static_cast<T>(0))
+	{
+		x.assign(b.size(), static_cast<T>(0));
+		return SolverReport{true, 0, 0};
+	}
+	if (vector_norm(r) / scale <= opt.tol)
+		return krylov_report(A, b, x, true, 0);
+	M.apply(r, z);
+	p = z;
+	T rz = dot_product<T>(r.begin(), r.end(), z.begin());
+	for (size_t it = 1; it <= opt.max_iter; it++)
+	{
+		A.apply(p, q);
+		T pq = dot_product<T>(p.begin(), p.end(), q.begin());
+		// A is not positive definite
+		if (!(pq > static_cast<T>(0)))
+			return krylov_report(A, b, x, false, it - 1);
+		T alpha = rz / pq;
+		for (size_t i = 0; i < x.size(); i++)
+		{
+			x[i] += alpha * p[i];
+			r[i] -= alpha * q[i];
+		}
+		double res = static_cast<double>(vector_norm(r) / scale);
+		if (opt.monitor)
+			opt.monitor(it, res);
+		if (res <= opt.tol)
+			return krylov_report(A, b, x, true, it);
+		M.apply(r, z);
+		T rz_next = dot_product<T>(r.begin(), r.end(), z.begin());
+		T beta = rz_next / rz;
+		rz = rz_next;
+		for (size_t i = 0; i < p.size(); i++)
+			p[i] = z[i] + beta * p[i];
+	}
+	return krylov_report(A, b, x, false, opt.max_iter);
+}
+
+// stabilized bi-conjugate gradients, right preconditioned, for general A
+// each iteration takes two products and counts as two
+template<typename T>
+inline SolverReport bicgstab(const LinearOperator<T> &A, const std::vector<T> &b, std::vector<T> &x, const Preconditioner<T> &M, const SolverOptions &opt = default_solver_options())
+{
+	std::vector<T> r, r0, p, v, s, t, ph, sh;
+	krylov_residual(A, b, x, r);
+	T scale = vector_norm(b);
+	if (scale == static_cast<T>(0))
+	{
+		x.assign(b.size(), static_cast<T>(0));
+		return SolverReport{true, 0, 0};
+	}
+	if (vector_norm(r) / scale <= opt.tol)
+		return krylov_report(A, b, x, true, 0);
+	r0 = r;
+	p.assign(r.size(), static_cast<T>(0));
+	v = p;
+	T rho = 1, alpha = 1, omega = 1;
+	size_t it = 0;
+	while (it < opt.max_iter)
+	{
+		T rho_next = dot_product<T>(r0.begin(), r0.end(), r.begin());
+		if (rho_next == static_cast<T>(0))
+			break;
+		T beta = rho_next / rho * (alpha / omega);
+		rho = rho_next;
+		for (size_t i = 0; i < p.size(); i++)
+			p[i] = r[i] + beta * (p[i] - omega * v[i]);
+		M.apply(p, ph);
+		A.apply(ph, v);
+		it++;
+		T r0v = dot_product<T>(r0.begin(), r0.end(), v.begin());
+		if (r0v == static_cast<T>(0))
+			break;
+		alpha = rho / r0v;
+		s = r;
+		for (size_t i = 0; i < s.size(); i++)
+			s[i] -= alpha * v[i];
+		double res = static_cast<double>(vector_norm(s) / scale);
+		if (res <= opt.tol)
+		{
+			for (size_t i = 0; i < x.size(); i++)
+				x[i] += alpha * ph[i];
+			if (opt.monitor)
+				opt.monitor(it, res);
+			return krylov_report(A, b, x, true, it);
+		}
+		M.apply(s, sh);
+		A.apply(sh, t);
+		it++;
+		T tt = dot_product<T>(t.begin(), t.end(), t.begin());
+		omega = tt == static_cast<T>(0) ? static_cast<T>(0) : dot_product<T>(t.begin(), t.end(), s.begin()) / tt;
+		for (size_t i = 0; i < x.size(); i++)
+		{
+			x[i] += alpha * ph[i] + omega * sh[i];
+			r[i] = s[i] - omega * t[i];
+		}
+		res = static_cast<double>(vector_norm(r) / scale);
+		if (opt.monitor)
+			opt.monitor(it, res);
+		if (res <= opt.tol)
+			return krylov_report(A, b, x, true, it);
+		if (omega == static_cast<T>(0))
+			break;
+	}
+	return krylov_report(A, b, x, false, it);
+}
+
+// restarted generalized minimal residuals, right preconditioned, for general A
+template<typename T>
+inline SolverReport gmres(const LinearOperator<T> &A, const std::vector<T> &b, std::vector<T> &x, const Preconditioner<T> &M, const SolverOptions &opt = default_solver_options())
+{
+	std::vector<T> r, w, z;
+	krylov_residual(A, b, x, r);
+	T scale = vector_norm(b);
+	if (scale == static_cast<T>(0))
+	{
+		x.assign(b.size(), static_cast<T>(0));
+		return SolverReport{true, 0, 0};
+	}
+	size_t m = std::max<size_t>(opt.restart, 1);
+	// orthonormal basis, Hessenberg matrix reduced to triangular by Givens rotations
+	std::vector<std::vector<T>> V(m + 1), H(m + 1, std::vector<T>(m));
+	std::vector<T> cs(m), sn(m), g(m + 1);
+	size_t it = 0;
+	for (;;)
+	{
+		T beta = vector_norm(r);
+		if (beta / scale <= opt.tol)
+			return krylov_report(A, b, x, true, it);
+		if (it >= opt.max_iter)
+			return krylov_report(A, b, x, false, it);
+		V[0] = r;
+		for (T &e : V[0])
+			e /= beta;
+		std::fill(g.begin(), g.end(), static_cast<T>(0));
+		g[0] = beta;
+		size_t k = 0;
+		bool stop = false;
+		while (k < m && it < opt.max_iter && !stop)
+		{
+			M.apply(V[k], z);
+			A.apply(z, w);
+			it++;
+			// modified Gram-Schmidt
+			for (size_t i = 0; i <= k; i++)
+			{
+				H[i][k] = dot_product<T>(w.begin(), w.end(), V[i].begin());
+				for (size_t l = 0; l < w.size(); l++)
+					w[l] -= H[i][k] * V[i][l];
+			}
+			T h = vector_norm(w);
+			for (size_t i = 0; i < k; i++)
+			{
+				T a = H[i][k], c = H[i + 1][k];
+				H[i][k] = cs[i] * a + sn[i] * c;
+				H[i + 1][k] = cs[i] * c - sn[i] * a;
+			}
+			T d = std::hypot(H[k][k], h);
+			cs[k] = d == static_cast<T>(0) ? static_cast<T>(1) : H[k][k] / d;
+			sn[k] = d == static_cast<T>(0) ? static_cast<T>(0) : h / d;
+			H[k][k] = d;
+			g[k + 1] = -sn[k] * g[k];
+			g[k] = cs[k] * g[k];
+			double res = static_cast<double>(std::fabs(g[k + 1]) / scale);
+			if (opt.monitor)
+				opt.monitor(it, res);
+			// the residual reached the tolerance or the space is invariant
+			stop = res <= opt.tol || h == static_cast<T>(0);
+			if (!stop)
+			{
+				V[k + 1] = w;
+				for (T &e : V[k + 1])
+					e /= h;
+			}
+			k++;
+		}
+
+		// x += M^-1 V y, with H y = g over the first k rows
+		std::vector<T> y(k);
+		for (size_t i = k; i-- > 0;)
+		{
+			T sum = g[i];
+			for (size_t j = i + 1; j < k; j++)
+				sum -= H[i][j] * y[j];
+			if (H[i][i] == static_cast<T>(0))
+				return krylov_report(A, b, x, false, it);
+			y[i] = sum / H[i][i];
+		}
+		std::vector<T> u(x.size(), static_cast<T>(0));
+		for (size_t j = 0; j < k; j++)
+			for (size_t l = 0; l < u.size(); l++)
+				u[l] += y[j] * V[j][l];
+		M.apply(u, z);
+		for (size_t l = 0; l < x.size(); l++)
+			x[l] += z[l];
+		krylov_residual(A, b, x, r);
+	}
+}
+
+#endif
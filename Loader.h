@@ -0,0 +1,235 @@
+
+#ifndef _LOADER_H_
+#define _LOADER_H_
+
+#include <stdexcept>
+#include <ios>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <charconv>
+#include <system_error>
+#include <thread>
+#include <cstring>
+#include <cstddef>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Frac.h"
+#include "Matrix.h"
+#include "Pipeline.h"
+
+// parse a whole token as an entry of T, false if it is not one
+template<typename T>
+struct entry_parser
+{
+	static inline bool parse(const char *first, const char *last, T &x)
+	{
+		if constexpr (std::is_integral<T>::value)
+		{
+			std::from_chars_result r = std::from_chars(first, last, x);
+			return r.ec == std::errc() && r.ptr == last;
+		}
+		else
+		{
+			std::istringstream iss(std::string(first, last));
+			return (iss >> x) && iss.peek() == std::char_traits<char>::eof();
+		}
+	}
+};
+
+// [-]numerator[/denominator], as read by operator>> of Frac
+template<typename U>
+struct entry_parser<Frac<U>>
+{
+	static inline bool parse(const char *first, const char *last, Frac<U> &x)
+	{
+		bool neg = first != last && *first == '-';
+		if (neg)
+			first++;
+		U num, den = 1;
+		std::from_chars_result r = std::from_chars(first, last, num);
+		if (r.ec != std::errc() || r.ptr == first)
+			return false;
+		if (r.ptr != last)
+		{
+			if (*r.ptr != '/')
+				return false;
+			first = r.ptr + 1;
+			r = std::from_chars(first, last, den);
+			if (r.ec != std::errc() || r.ptr != last || den == 0)
+				return false;
+		}
+		x = Frac<U>(num, den, neg);
+		return true;
+	}
+};
+
+// parse the lines of [begin, end) up to the first blank line into a matrix,
+// in line-aligned chunks on threads, each chunk filling its own rows;
+// of the bad lines the first one is reported, whatever the threads
+template<typename T>
+inline Matrix<T> parse_matrix(const char *begin, const char *end, size_t threads = 0, const std::string &name = "input")
+{
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	std::vector<const char *> cuts{begin};
+	for (size_t t = 1; t < threads; t++)
+	{
+		const char *p = begin + (end - begin) * t / threads;
+		if (p < cuts.back())
+			p = cuts.back();
+		const char *nl = static_cast<const char *>(std::memchr(p, '\n', end - p));
+		cuts.push_back(nl == nullptr ? end : nl + 1);
+	}
+	cuts.push_back(end);
+	size_t chunks = cuts.size() - 1;
+
+	// lines of each chunk, up to a blank line
+	std::vector<size_t> lines(chunks, 0);
+	std::vector<bool> blank(chunks, false);
+	parallel_for(chunks, threads, [&cuts, &lines, &blank](size_t c)
+		{
+			for (const char *p = cuts[c]; p < cuts[c + 1];)
+			{
+				const char *nl = static_cast<const char *>(std::memchr(p, '\n', cuts[c + 1] - p));
+				if (nl == p || (nl == p + 1 && *p == '\r'))
+				{
+					blank[c] = true;
+					return;
+				}
+				lines[c]++;
+				p = nl == nullptr ? cuts[c + 1] : nl + 1;
+			}
+		});
+	std::vector<size_t> first_row(chunks + 1, 0);
+	for (size_t c = 0; c < chunks; c++)
+		first_row[c + 1] = first_row[c] + lines[c];
+	for (size_t c = 0; c < chunks; c++)
+		if (blank[c])
+		{
+			for (size_t d = c + 1; d <= chunks; d++)
+				first_row[d] = first_row[c + 1];
+			break;
+		}
+	size_t rows = first_row[chunks];
+	if (rows == 0)
+		return Matrix<T>();
+
+	// columns from the first line
+	size_t cols = 0;
+	for (const char *p = begin; p < end && *p != '\n';)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+		if (p == end || *p == '\n')
+			break;
+		cols++;
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+			p++;
+	}
+
+	// parse the rows, each chunk stopping at its first bad line
+	std::vector<std::vector<T>> e(rows);
+	std::vector<size_t> bad(chunks, std::numeric_limits<size_t>::max());
+	std::vector<std::string> why(chunks);
+	parallel_for(chunks, threads, [&](size_t c)
+		{
+			const char *p = cuts[c];
+			for (size_t i = first_row[c]; i < first_row[c + 1]; i++)
+			{
+				const char *eol = static_cast<const char *>(std::memchr(p, '\n', cuts[c + 1] - p));
+				if (eol == nullptr)
+					eol = cuts[c + 1];
+				std::vector<T> &row = e[i];
+				row.reserve(cols);
+				while (p < eol)
+				{
+					while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+						p++;
+					if (p == eol)
+						break;
+					const char *token = p;
+					while (p < eol && *p != ' ' && *p != '\t' && *p != '\r')
+						p++;
+					T x;
+					bool valid;
+					try
+					{
+						valid = entry_parser<T>::parse(token, p, x);
+					}
+					catch (const std::exception &)
+					{
+						valid = false;
+					}
+					if (!valid)
+					{
+						bad[c] = i;
+						// the position only, the content of the file is not echoed
+						why[c] = "invalid entry " + std::to_string(row.size() + 1);
+						return;
+					}
+					row.push_back(std::move(x));
+				}
+				if (row.size() != cols)
+				{
+					bad[c] = i;
+					why[c] = std::to_string(row.size()) + " entries in a matrix of " + std::to_string(cols) + " columns";
+					return;
+				}
+				p = eol + 1;
+			}
+		});
+	for (size_t c = 0; c < chunks; c++)
+		if (bad[c] != std::numeric_limits<size_t>::max())
+			throw std::ios_base::failure(name + ':' + std::to_string(bad[c] + 1) + ": " + why[c]);
+	return Matrix<T>(std::move(e));
+}
+
+// load a matrix from a file, mapped into memory and parsed in parallel,
+// errors name the file by name, its path by default
+template<typename T>
+inline Matrix<T> load_matrix(const std::string &path, size_t threads = 0, std::string name = "")
+{
+	if (name.empty())
+		name = path;
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::ios_base::failure("cannot open " + name);
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		::close(fd);
+		throw std::ios_base::failure(name + " is not a regular file");
+	}
+	size_t size = st.st_size;
+	if (size == 0)
+	{
+		::close(fd);
+		return Matrix<T>();
+	}
+	void *map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED)
+		throw std::ios_base::failure("cannot map " + name);
+	::madvise(map, size, MADV_WILLNEED);
+	const char *data = static_cast<const char *>(map);
+	try
+	{
+		Matrix<T> A = parse_matrix<T>(data, data + size, threads, name);
+		::munmap(map, size);
+		return A;
+	}
+	catch (...)
+	{
+		::munmap(map, size);
+		throw;
+	}
+}
+
+#endif
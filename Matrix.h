@@ -8,7 +8,12 @@
 #include <ostream>
 #include <sstream>
 #include <vector>
+#include <type_traits>
+#include <algorithm>
 #include "Vector.h"
+#include "FracVector.h"
+#include "Tuning.h"
+#include "Pipeline.h"
 
 template<typename T>
 class Matrix
@@ -21,15 +26,26 @@ class Matrix
 		inline Matrix() {}
 		inline Matrix(size_t num_row, size_t num_col) : e(num_row, std::vector<T>(num_col)) {}
 		inline Matrix(const Matrix &A) : e(A.e) {}
-		inline Matrix(Matrix &&A) : e(std::forward<std::vector<std::vector<T>>>(A.e)) {}
+		inline Matrix(Matrix &&A) noexcept : e(std::move(A.e)) {}
+
+		// construct from rows of equal length, taking over their storage
+		inline Matrix(std::vector<std::vector<T>> &&rows) : e(std::move(rows))
+		{
+			for (const std::vector<T> &v : e)
+				if (v.size() != e.front().size())
+					throw std::invalid_argument("rows of different lengths");
+		}
 
 		// assign operators
 		inline Matrix & operator=(const Matrix &A) {e = A.e; return *this;}
-		inline Matrix & operator=(Matrix &&A) {e = std::forward(A.e); return *this;}
+		inline Matrix & operator=(Matrix &&A) noexcept {e = std::move(A.e); return *this;}
 
 		// clear
 		inline Matrix & clear() {e.clear(); return *this;}
 
+		// exchange contents
+		inline Matrix & swap(Matrix &A) noexcept {e.swap(A.e); return *this;}
+
 		// resize
 		inline Matrix & resize(size_t r, size_t c)
 		{
@@ -174,8 +190,15 @@ class Matrix
 		}
 
 		// line reduce into REF
-		inline Matrix & reduce_to_ref(size_t aug = 0)
+		inline Matrix & reduce_to_ref(size_t aug = 0) {return reduce_to_ref(aug, tuning<T>());}
+		inline Matrix & reduce_to_ref(size_t aug, const TuningParams &p)
 		{
+			if constexpr (frac_kernel<T>::value)
+			{
+				frac_reduce_to_ref(e, aug, p);
+				return *this;
+			}
+			WorkerTeam team(row() * col() >= p.ref_parallel ? p.ref_threads : 1);
 			size_t leading = 0;
 			for (size_t j = 0; leading < row() && j < col() - aug; j++)
 			{
@@ -193,9 +216,11 @@ class Matrix
 						continue;
 				}
 				row(leading) /= e[leading][j];
-				for (size_t i = 0; i < row(); i++)
-					if (i != leading)
-						row(i) -= e[i][j] * row(leading);
+				team.run(row(), [this, leading, j](size_t i)
+					{
+						if (i != leading)
+							row(i) -= e[i][j] * row(leading);
+					});
 				leading++;
 			}
 			return *this;
@@ -204,12 +229,228 @@ class Matrix
 		// get the reduced form of the Matrix
 		inline Matrix ref(size_t aug = 0) const {return Matrix(*this).reduce_to_ref(aug);}
 
+		// pivot columns of the reduced form
+		inline std::vector<size_t> pivots(size_t aug = 0) const {return ref_pivots(ref(aug), aug);}
+
+		// pivot columns of a matrix already in reduced form
+		static inline std::vector<size_t> ref_pivots(const Matrix &R, size_t aug = 0)
+		{
+			std::vector<size_t> p;
+			for (size_t i = 0, j = 0; i < R.row(); i++)
+			{
+				while (j < R.col() - aug && R.e[i][j] == static_cast<T>(0))
+					j++;
+				if (j == R.col() - aug)
+					break;
+				p.push_back(j);
+			}
+			return p;
+		}
+
+		// rank
+		inline size_t rank() const {return pivots().size();}
+
+		// basis of the nullspace as columns
+		inline Matrix null() const
+		{
+			Matrix R = ref();
+			std::vector<size_t> p = ref_pivots(R);
+			Matrix N(col(), col() - p.size());
+			for (size_t j = 0, k = 0, f = 0; j < col(); j++)
+			{
+				if (k < p.size() && p[k] == j)
+				{
+					k++;
+					continue;
+				}
+				N.e[j][f] = static_cast<T>(1);
+				for (size_t i = 0; i < p.size(); i++)
+					N.e[p[i]][f] = -R.e[i][j];
+				f++;
+			}
+			return N;
+		}
+
+		// basis of the column space as columns
+		inline Matrix col_space() const
+		{
+			std::vector<size_t> p = pivots();
+			Matrix C(row(), p.size());
+			for (size_t i = 0; i < row(); i++)
+				for (size_t k = 0; k < p.size(); k++)
+					C.e[i][k] = e[i][p[k]];
+			return C;
+		}
+
+		// characteristic polynomial det(xI - A), coefficients by increasing degree
+		// Hessenberg reduction for floating point, otherwise the division-free Berkowitz
+		// algorithm, exact as long as T does not overflow
+		inline std::vector<T> charpoly() const
+		{
+			if constexpr (std::is_floating_point<T>::value)
+				return charpoly_hessenberg();
+			else
+				return charpoly_berkowitz();
+		}
+
+		// characteristic polynomial through reduction to upper Hessenberg form, O(n^3)
+		inline std::vector<T> charpoly_hessenberg() const
+		{
+			if (row() != col())
+				throw std::invalid_argument("characteristic polynomial of non-square Matrix");
+			size_t n = row();
+			Matrix H(*this);
+
+			// similarity transformations into Hessenberg form
+			for (size_t m = 1; m + 1 < n; m++)
+			{
+				size_t i = m;
+				while (i < n && H.e[i][m-1] == static_cast<T>(0))
+					i++;
+				if (i == n)
+					continue;
+				if (i != m)
+				{
+					std::swap(H.e[i], H.e[m]);
+					for (std::vector<T> &v : H.e)
+						std::swap(v[i], v[m]);
+				}
+				T pivot = H.e[m][m-1];
+				for (size_t j = m + 1; j < n; j++)
+				{
+					if (H.e[j][m-1] == static_cast<T>(0))
+						continue;
+					T u = H.e[j][m-1] / pivot;
+					for (size_t k = 0; k < n; k++)
+						H.e[j][k] -= u * H.e[m][k];
+					for (size_t k = 0; k < n; k++)
+						H.e[k][m] += u * H.e[k][j];
+				}
+			}
+
+			// recurrence on the leading principal submatrices
+			std::vector<std::vector<T>> p(n + 1);
+			p[0].push_back(static_cast<T>(1));
+			for (size_t m = 1; m <= n; m++)
+			{
+				p[m].assign(m + 1, static_cast<T>(0));
+				for (size_t k = 0; k < m; k++)
+				{
+					p[m][k+1] += p[m-1][k];
+					p[m][k] -= H.e[m-1][m-1] * p[m-1][k];
+				}
+				T t = static_cast<T>(1);
+				for (size_t i = 1; i < m; i++)
+				{
+					t *= H.e[m-i][m-i-1];
+					if (t == static_cast<T>(0))
+						break;
+					T c = t * H.e[m-i-1][m-1];
+					for (size_t k = 0; k < m - i; k++)
+						p[m][k] -= c * p[m-i-1][k];
+				}
+			}
+			return p[n];
+		}
+
+		// characteristic polynomial by the division-free Berkowitz algorithm, O(n^4)
+		inline std::vector<T> charpoly_berkowitz() const
+		{
+			if (row() != col())
+				throw std::invalid_argument("characteristic polynomial of non-square Matrix");
+			size_t n = row();
+			if (n == 0)
+				return std::vector<T>(1, static_cast<T>(1));
+
+			// coefficients by decreasing degree of the trailing principal submatrices
+			std::vector<T> p = {static_cast<T>(1), -e[n-1][n-1]};
+			for (size_t k = n - 1; k-- > 0;)
+			{
+				size_t m = n - k - 1;
+
+				// first column of the Toeplitz matrix: 1, -a, -R C, -R A C, ...
+				std::vector<T> t = {static_cast<T>(1), -e[k][k]};
+				std::vector<T> v(m);
+				for (size_t i = 0; i < m; i++)
+					v[i] = e[k+1+i][k];
+				for (size_t r = 0; r < m; r++)
+				{
+					T s = static_cast<T>(0);
+					for (size_t i = 0; i < m; i++)
+						s += e[k][k+1+i] * v[i];
+					t.push_back(-s);
+					std::vector<T> w(m, static_cast<T>(0));
+					for (size_t i = 0; i < m; i++)
+						for (size_t j = 0; j < m; j++)
+							w[i] += e[k+1+i][k+1+j] * v[j];
+					v = std::move(w);
+				}
+
+				// multiply by the lower triangular Toeplitz matrix
+				std::vector<T> q(m + 2, static_cast<T>(0));
+				for (size_t i = 0; i < m + 2; i++)
+					for (size_t j = 0; j <= i && j < m + 1; j++)
+						q[i] += t[i-j] * p[j];
+				p = std::move(q);
+			}
+			return std::vector<T>(p.rbegin(), p.rend());
+		}
+
 		// determinant
-		// use the naive method
-		inline T det() const
+		// fraction-free elimination for the row kernel Frac types, otherwise cofactor
+		// expansion for small matrices, then Gaussian elimination for types with a
+		// division and the Berkowitz algorithm for integers
+		inline T det() const {return det(tuning<T>());}
+		inline T det(const TuningParams &p) const
+		{
+			if (row() != col())
+				throw std::invalid_argument("determinant of non-square Matrix");
+			// cofactor sums of Frac overflow silently, so those always take the exact path
+			if constexpr (frac_kernel<T>::value)
+				return frac_det(e, p);
+			else if (row() <= p.det_naive)
+				return det_naive();
+			else if constexpr (!std::is_integral<T>::value)
+			{
+				std::vector<std::vector<T>> a(e);
+				T result = static_cast<T>(1);
+				for (size_t j = 0; j < row(); j++)
+				{
+					size_t i = j;
+					while (i < row() && a[i][j] == static_cast<T>(0))
+						i++;
+					if (i == row())
+						return static_cast<T>(0);
+					if (i != j)
+					{
+						std::swap(a[i], a[j]);
+						result = -result;
+					}
+					result *= a[j][j];
+					for (i = j + 1; i < row(); i++)
+						if (a[i][j] != static_cast<T>(0))
+						{
+							T u = a[i][j] / a[j][j];
+							for (size_t k = j + 1; k < col(); k++)
+								a[i][k] -= u * a[j][k];
+						}
+				}
+				return result;
+			}
+			else
+			{
+				std::vector<T> p = charpoly_berkowitz();
+				return row() % 2 == 0 ? p[0] : -p[0];
+			}
+		}
+
+		// determinant by cofactor expansion
+		inline T det_naive() const
 		{
 			if (row() != col())
 				throw std::invalid_argument("determinant of non-square Matrix");
+			if (row() == 0)
+				return static_cast<T>(1);
 			if (row() == 1)
 				return e[0][0];
 
@@ -224,11 +465,39 @@ class Matrix
 					A.e[i].insert(A.e[i].end(), e[i+1].begin(), e[i+1].begin() + j);
 					A.e[i].insert(A.e[i].end(), e[i+1].begin() + j + 1, e[i+1].end());
 				}
-				result += (j%2==0 ? e[0][j] : -e[0][j]) * A.det();
+				result += (j%2==0 ? e[0][j] : -e[0][j]) * A.det_naive();
 			}
 			return result;
 		}
 
+		// solve the linear system A x = b, free variables are set to 0
+		template<bool C>
+		inline Vector<T> solve(const Vector<T, C> &b) const
+		{
+			if (b.size() != row())
+				throw std::invalid_argument("linear system with incompatible dimensions");
+			Matrix R(*this);
+			for (size_t i = 0; i < row(); i++)
+				R.e[i].push_back(b[i]);
+			R.reduce_to_ref(1);
+			Vector<T> x(col());
+			for (size_t j = 0; j < col(); j++)
+				x[j] = static_cast<T>(0);
+			for (size_t i = 0, j = 0; i < row(); i++)
+			{
+				while (j < col() && R.e[i][j] == static_cast<T>(0))
+					j++;
+				if (j == col())
+				{
+					if (R.e[i][j] != static_cast<T>(0))
+						throw std::invalid_argument("inconsistent linear system");
+					continue;
+				}
+				x[j] = R.e[i][col()];
+			}
+			return x;
+		}
+
 		// matrix addition
 		inline Matrix & operator+=(const Matrix &A)
 		{
@@ -238,7 +507,11 @@ class Matrix
 				row(i) += A.row(i);
 			return *this;
 		}
-		inline Matrix operator+(const Matrix &A) const {return Matrix(*this) += A;}
+		// temporary operands are reused for the result
+		inline Matrix operator+(const Matrix &A) const & {return Matrix(*this) += A;}
+		inline Matrix operator+(const Matrix &A) && {return std::move(*this += A);}
+		inline Matrix operator+(Matrix &&A) const & {return std::move(A += *this);}
+		inline Matrix operator+(Matrix &&A) && {return std::move(*this += A);}
 
 		// matrix subtraction
 		inline Matrix & operator-=(const Matrix &A)
@@ -249,20 +522,67 @@ class Matrix
 				row(i) -= A.row(i);
 			return *this;
 		}
-		inline Matrix operator-(const Matrix &A) const {return Matrix(*this) -= A;}
+		// temporary operands are reused for the result
+		inline Matrix operator-(const Matrix &A) const & {return Matrix(*this) -= A;}
+		inline Matrix operator-(const Matrix &A) && {return std::move(*this -= A);}
+		inline Matrix operator-(Matrix &&A) const &
+		{
+			if (row() != A.row() || col() != A.col())
+				throw std::invalid_argument("matrix subtraction with incompatible dimensions");
+			for (size_t i = 0; i < row(); i++)
+				for (size_t j = 0; j < col(); j++)
+					A.e[i][j] = e[i][j] - A.e[i][j];
+			return std::move(A);
+		}
+		inline Matrix operator-(Matrix &&A) && {return std::move(*this -= A);}
 
 		// matrix multiplication
-		inline Matrix operator*(const Matrix &A) const
+		inline Matrix operator*(const Matrix &A) const {return multiply(A, tuning<T>());}
+
+		// matrix multiplication in square tiles, so that a tile of rows and one of
+		// columns stay in cache, with the row tiles split across threads
+		inline Matrix multiply(const Matrix &A, const TuningParams &p) const
+		{
+			Matrix result;
+			multiply(A, result, p);
+			return result;
+		}
+
+		// matrix multiplication into result, reusing its storage
+		inline Matrix & multiply(const Matrix &A, Matrix &result) const {return multiply(A, result, tuning<T>());}
+		inline Matrix & multiply(const Matrix &A, Matrix &result, const TuningParams &p) const
 		{
 			if (col() != A.row())
 				throw std::invalid_argument("matrix multiplication with incompatible dimensions");
-			Matrix result(row(), A.col());
-			for (size_t i = 0; i < row(); i++)
+			if (&result == this || &result == &A)
+			{
+				Matrix tmp;
+				multiply(A, tmp, p);
+				return result.swap(tmp);
+			}
+			result.resize(row(), A.col());
+			std::vector<std::vector<T>> cols(A.col(), std::vector<T>(A.row()));
+			for (size_t i = 0; i < A.row(); i++)
 				for (size_t j = 0; j < A.col(); j++)
-					result.get(i, j) = row(i).dot(A.col(j));
+					cols[j][i] = A.e[i][j];
+			size_t b = p.mul_block == 0 ? 1 : p.mul_block;
+			size_t threads = row() * col() * A.col() >= p.mul_parallel ? p.mul_threads : 1;
+			parallel_for((row() + b - 1) / b, threads, [this, &result, &cols, b](size_t t)
+				{
+					size_t last = std::min(row(), (t + 1) * b);
+					for (size_t jb = 0; jb < cols.size(); jb += b)
+						for (size_t i = t * b; i < last; i++)
+							for (size_t j = jb; j < std::min(cols.size(), jb + b); j++)
+								result.e[i][j] = dot_product<T>(e[i].begin(), e[i].end(), cols[j].begin());
+				});
 			return result;
 		}
-		inline Matrix & operator*=(const Matrix &A) {return *this = *this * A;}
+		inline Matrix & operator*=(const Matrix &A)
+		{
+			Matrix result;
+			multiply(A, result, tuning<T>());
+			return swap(result);
+		}
 
 		// linear transformation
 		inline Vector<T> operator*(const Vector<T> &v) const
@@ -271,11 +591,154 @@ class Matrix
 				throw std::invalid_argument("linear transformation with incompatible dimensions");
 			Vector<T> result(row());
 			for (size_t i = 0; i < row(); i++)
-				result[i] = row(i).dot(v);
+				result[i] = dot_product<T>(e[i].begin(), e[i].end(), v.begin());
 			return result;
 		}
-		inline Vector<T> & transform(Vector<T> &v) const {v = *this * v;}
+		inline Vector<T> & transform(Vector<T> &v) const
+		{
+			if (row() != col())
+				throw std::invalid_argument("in-place transformation by non-square Matrix");
+			Vector<T> result = *this * v;
+			for (size_t i = 0; i < v.size(); i++)
+				v[i] = result[i];
+			return v;
+		}
 };
 
+// k-th power of a square matrix by binary exponentiation,
+// the products alternate between two buffers
+template<typename T>
+inline Matrix<T> pow(const Matrix<T> &A, unsigned long long k)
+{
+	if (A.row() != A.col())
+		throw std::invalid_argument("power of non-square Matrix");
+	TuningParams p = tuning<T>();
+	Matrix<T> result, base(A), tmp;
+	bool first = true;
+	for (; k != 0; k >>= 1)
+	{
+		if (k & 1)
+		{
+			if (first)
+				result = base;
+			else
+				result.multiply(base, tmp, p).swap(result);
+			first = false;
+		}
+		if (k > 1)
+			base.multiply(base, tmp, p).swap(base);
+	}
+	if (first)
+	{
+		result.resize(A.row(), A.col());
+		for (size_t i = 0; i < A.row(); i++)
+			for (size_t j = 0; j < A.col(); j++)
+				result.get(i, j) = static_cast<T>(i == j ? 1 : 0);
+	}
+	return result;
+}
+
+// parenthesization of a chain product with the fewest scalar multiplications,
+// split[i][j] is the last factor of the left part of the product of factors i to j
+inline std::vector<std::vector<size_t>> chain_order(const std::vector<size_t> &dims)
+{
+	size_t n = dims.size() - 1;
+	std::vector<std::vector<double>> cost(n, std::vector<double>(n, 0));
+	std::vector<std::vector<size_t>> split(n, std::vector<size_t>(n, 0));
+	for (size_t len = 1; len < n; len++)
+		for (size_t i = 0; i + len < n; i++)
+		{
+			size_t j = i + len;
+			cost[i][j] = -1;
+			for (size_t k = i; k < j; k++)
+			{
+				double c = cost[i][k] + cost[k + 1][j] + static_cast<double>(dims[i]) * dims[k + 1] * dims[j + 1];
+				if (cost[i][j] < 0 || c < cost[i][j])
+					cost[i][j] = c, split[i][j] = k;
+			}
+		}
+	return split;
+}
+
+// product of a chain of matrices in the cheapest order,
+// intermediate products reuse the buffers of finished ones
+template<typename T>
+class ChainProduct
+{
+	private:
+		const std::vector<const Matrix<T> *> &factors;
+		std::vector<std::vector<size_t>> split;
+		std::vector<Matrix<T>> buffers;
+		TuningParams params;
+
+		inline void acquire(Matrix<T> &A)
+		{
+			if (!buffers.empty())
+			{
+				A.swap(buffers.back());
+				buffers.pop_back();
+			}
+		}
+
+		inline void release(Matrix<T> &A)
+		{
+			buffers.emplace_back();
+			buffers.back().swap(A);
+		}
+
+		// product of factors i to j into result
+		inline void evaluate(size_t i, size_t j, Matrix<T> &result)
+		{
+			size_t k = split[i][j];
+			Matrix<T> left, right;
+			if (k > i)
+			{
+				acquire(left);
+				evaluate(i, k, left);
+			}
+			if (k + 1 < j)
+			{
+				acquire(right);
+				evaluate(k + 1, j, right);
+			}
+			(k > i ? left : *factors[i]).multiply(k + 1 < j ? right : *factors[j], result, params);
+			if (k > i)
+				release(left);
+			if (k + 1 < j)
+				release(right);
+		}
+
+	public:
+		inline ChainProduct(const std::vector<const Matrix<T> *> &f) : factors(f), params(tuning<T>())
+		{
+			if (f.empty())
+				throw std::invalid_argument("product of no matrices");
+			std::vector<size_t> dims{f[0]->row()};
+			for (size_t i = 0; i < f.size(); i++)
+			{
+				if (f[i]->row() != dims.back())
+					throw std::invalid_argument("matrix multiplication with incompatible dimensions");
+				dims.push_back(f[i]->col());
+			}
+			split = chain_order(dims);
+		}
+
+		inline Matrix<T> result()
+		{
+			Matrix<T> R;
+			if (factors.size() == 1)
+				R = *factors[0];
+			else
+				evaluate(0, factors.size() - 1, R);
+			return R;
+		}
+};
+
+template<typename T>
+inline Matrix<T> chain_product(const std::vector<const Matrix<T> *> &factors)
+{
+	return ChainProduct<T>(factors).result();
+}
+
 #endif
 
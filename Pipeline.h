@@ -0,0 +1,241 @@
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <cstddef>
+#include <utility>
+#include <exception>
+#include <limits>
+#include <algorithm>
+
+// queue with a bounded capacity, producers block while it is full
+template<typename T>
+class BoundedQueue
+{
+	private:
+		std::mutex lock;
+		std::condition_variable not_full, not_empty;
+		std::deque<T> items;
+		size_t limit;
+		bool closed;
+
+	public:
+		inline BoundedQueue(size_t capacity) : limit(capacity), closed(false) {}
+		BoundedQueue(const BoundedQueue &) = delete;
+		BoundedQueue & operator=(const BoundedQueue &) = delete;
+
+		// append an item, waiting for room, returns false if the queue is closed
+		inline bool push(T item)
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			not_full.wait(guard, [this]() {return closed || items.size() < limit;});
+			if (closed)
+				return false;
+			items.push_back(std::move(item));
+			not_empty.notify_one();
+			return true;
+		}
+
+		// take the first item, waiting for one, returns false once closed and drained
+		inline bool pop(T &item)
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			not_empty.wait(guard, [this]() {return closed || !items.empty();});
+			if (items.empty())
+				return false;
+			item = std::move(items.front());
+			items.pop_front();
+			not_full.notify_one();
+			return true;
+		}
+
+		// stop accepting items, pending ones can still be taken
+		inline void close()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			closed = true;
+			not_full.notify_all();
+			not_empty.notify_all();
+		}
+};
+
+// threads a parallel loop started from this thread may use,
+// the workers of a pool get their share of the cores, those of a team one each
+inline size_t & thread_budget()
+{
+	thread_local size_t budget = std::numeric_limits<size_t>::max();
+	return budget;
+}
+
+// fixed set of worker threads running tasks in submission order
+class ThreadPool
+{
+	private:
+		BoundedQueue<std::function<void()>> tasks;
+		std::vector<std::thread> workers;
+
+	public:
+		inline ThreadPool(size_t threads, size_t capacity) : tasks(capacity)
+		{
+			if (threads == 0)
+				threads = 1;
+			size_t share = std::max<size_t>(1, std::thread::hardware_concurrency() / threads);
+			for (size_t i = 0; i < threads; i++)
+				workers.emplace_back([this, share]()
+					{
+						thread_budget() = share;
+						std::function<void()> task;
+						while (tasks.pop(task))
+							task();
+					});
+		}
+		ThreadPool(const ThreadPool &) = delete;
+		ThreadPool & operator=(const ThreadPool &) = delete;
+
+		// finish the queued tasks and join the workers
+		inline ~ThreadPool()
+		{
+			tasks.close();
+			for (std::thread &t : workers)
+				t.join();
+		}
+
+		// number of workers
+		inline size_t size() const {return workers.size();}
+
+		// queue a task, waiting while the queue is full
+		template<typename F>
+		inline std::shared_future<typename std::invoke_result<F>::type> submit(F f)
+		{
+			typedef typename std::invoke_result<F>::type R;
+			std::shared_ptr<std::packaged_task<R()>> task = std::make_shared<std::packaged_task<R()>>(std::move(f));
+			std::shared_future<R> result = task->get_future().share();
+			tasks.push([task]() {(*task)();});
+			return result;
+		}
+};
+
+// threads kept for a sequence of parallel loops, such as the pivots of an elimination,
+// each loop is split into contiguous ranges, the calling thread takes the first one
+class WorkerTeam
+{
+	private:
+		std::mutex lock;
+		std::condition_variable start, done;
+		std::vector<std::thread> workers;
+		std::vector<std::exception_ptr> errors;
+		void (*call)(const void *, size_t, size_t);
+		const void *body;
+		size_t count, generation, pending;
+		bool stopping;
+
+		inline void range(size_t t)
+		{
+			try
+			{
+				call(body, count * t / size(), count * (t + 1) / size());
+			}
+			catch (...)
+			{
+				errors[t] = std::current_exception();
+			}
+		}
+
+	public:
+		inline WorkerTeam(size_t threads) : call(nullptr), body(nullptr), count(0), generation(0), pending(0), stopping(false)
+		{
+			threads = std::max<size_t>(1, std::min(threads, thread_budget()));
+			errors.resize(threads);
+			for (size_t t = 1; t < threads; t++)
+				workers.emplace_back([this, t]()
+					{
+						thread_budget() = 1;
+						for (size_t seen = 0; ; )
+						{
+							std::unique_lock<std::mutex> guard(lock);
+							start.wait(guard, [this, seen]() {return stopping || generation != seen;});
+							if (stopping)
+								return;
+							seen = generation;
+							guard.unlock();
+							range(t);
+							guard.lock();
+							if (--pending == 0)
+								done.notify_one();
+						}
+					});
+		}
+		WorkerTeam(const WorkerTeam &) = delete;
+		WorkerTeam & operator=(const WorkerTeam &) = delete;
+
+		inline ~WorkerTeam()
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				stopping = true;
+			}
+			start.notify_all();
+			for (std::thread &w : workers)
+				w.join();
+		}
+
+		// number of threads including the calling one
+		inline size_t size() const {return workers.size() + 1;}
+
+		// call f(i) for i in [0, n) on the team, the first exception is rethrown
+		template<typename F>
+		inline void run(size_t n, const F &f)
+		{
+			if (workers.empty() || n <= 1)
+			{
+				for (size_t i = 0; i < n; i++)
+					f(i);
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				call = [](const void *b, size_t first, size_t last)
+				{
+					for (size_t i = first; i < last; i++)
+						(*static_cast<const F *>(b))(i);
+				};
+				body = &f;
+				count = n;
+				pending = workers.size();
+				generation++;
+			}
+			start.notify_all();
+			range(0);
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				done.wait(guard, [this]() {return pending == 0;});
+			}
+			for (std::exception_ptr &e : errors)
+				if (e)
+				{
+					std::exception_ptr first = e;
+					for (std::exception_ptr &r : errors)
+						r = nullptr;
+					std::rethrow_exception(first);
+				}
+		}
+};
+
+// call f(i) for i in [0, count) split into contiguous ranges over threads,
+// the calling thread takes the first range, the first exception is rethrown
+template<typename F>
+inline void parallel_for(size_t count, size_t threads, F f)
+{
+	WorkerTeam(std::min(threads, count)).run(count, f);
+}
+
+#endif
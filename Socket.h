@@ -0,0 +1,116 @@
+
+#ifndef _SOCKET_H_
+#define _SOCKET_H_
+
+#include <ios>
+#include <streambuf>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// stream buffer reading from and writing to a socket
+class fd_streambuf : public std::streambuf
+{
+	private:
+		int fd;
+		char ibuf[4096], obuf[4096];
+
+		inline bool flush_out()
+		{
+			const char *p = pbase();
+			while (p < pptr())
+			{
+				ssize_t put = ::send(fd, p, pptr() - p, MSG_NOSIGNAL);
+				if (put < 0 && errno == EINTR)
+					continue;
+				if (put <= 0)
+					return false;
+				p += put;
+			}
+			setp(obuf, obuf + sizeof(obuf));
+			return true;
+		}
+
+	protected:
+		inline int_type underflow() override
+		{
+			ssize_t got;
+			do
+				got = ::recv(fd, ibuf, sizeof(ibuf), 0);
+			while (got < 0 && errno == EINTR);
+			if (got <= 0)
+				return traits_type::eof();
+			setg(ibuf, ibuf, ibuf + got);
+			return traits_type::to_int_type(*gptr());
+		}
+
+		inline int_type overflow(int_type c) override
+		{
+			if (!flush_out())
+				return traits_type::eof();
+			if (!traits_type::eq_int_type(c, traits_type::eof()))
+				sputc(traits_type::to_char_type(c));
+			return traits_type::not_eof(c);
+		}
+
+		inline int sync() override {return flush_out() ? 0 : -1;}
+
+	public:
+		inline fd_streambuf(int file) : fd(file)
+		{
+			setg(ibuf, ibuf, ibuf);
+			setp(obuf, obuf + sizeof(obuf));
+		}
+		inline ~fd_streambuf() override {sync();}
+		fd_streambuf(const fd_streambuf &) = delete;
+		fd_streambuf & operator=(const fd_streambuf &) = delete;
+};
+
+inline sockaddr_un unix_address(const std::string &path)
+{
+	sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+		throw std::ios_base::failure("socket path too long: " + path);
+	std::strcpy(addr.sun_path, path.c_str());
+	return addr;
+}
+
+// listen on a Unix domain socket, replacing a stale socket file
+inline int listen_unix(const std::string &path, int backlog = 64)
+{
+	sockaddr_un addr = unix_address(path);
+	int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		throw std::ios_base::failure("cannot create socket");
+	::unlink(path.c_str());
+	if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(fd, backlog) != 0)
+	{
+		::close(fd);
+		throw std::ios_base::failure("cannot listen on " + path);
+	}
+	return fd;
+}
+
+// connect to a Unix domain socket
+inline int connect_unix(const std::string &path)
+{
+	sockaddr_un addr = unix_address(path);
+	int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		throw std::ios_base::failure("cannot create socket");
+	if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+	{
+		::close(fd);
+		throw std::ios_base::failure("cannot connect to " + path);
+	}
+	return fd;
+}
+
+#endif
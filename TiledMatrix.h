@@ -0,0 +1,555 @@
+
+#ifndef _TILEDMATRIX_H_
+#define _TILEDMATRIX_H_
+
+#include <stdexcept>
+#include <ios>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Matrix.h"
+
+// bytes available to tile buffers of the out-of-core operations
+class TileBudget
+{
+	private:
+		size_t limit;
+		std::atomic<size_t> used;
+	public:
+		inline TileBudget(size_t bytes) : limit(bytes), used(0) {}
+		TileBudget(const TileBudget &) = delete;
+		TileBudget & operator=(const TileBudget &) = delete;
+
+		inline size_t capacity() const {return limit;}
+		inline size_t in_use() const {return used;}
+
+		inline void acquire(size_t bytes)
+		{
+			if (used.fetch_add(bytes) + bytes > limit)
+			{
+				used -= bytes;
+				throw std::invalid_argument("memory budget too small for out-of-core operation");
+			}
+		}
+		inline void release(size_t bytes) {used -= bytes;}
+};
+
+// buffer of elements charged against a TileBudget
+template<typename T>
+class TileBuffer
+{
+	private:
+		TileBudget &budget;
+		size_t n;
+		std::unique_ptr<T[]> p;
+	public:
+		inline TileBuffer(TileBudget &b, size_t size) : budget(b), n(size)
+		{
+			budget.acquire(n * sizeof(T));
+			p.reset(new T[n]);
+		}
+		inline ~TileBuffer() {budget.release(n * sizeof(T));}
+		TileBuffer(const TileBuffer &) = delete;
+		TileBuffer & operator=(const TileBuffer &) = delete;
+
+		inline size_t size() const {return n;}
+		inline T * data() {return p.get();}
+		inline const T * data() const {return p.get();}
+		inline T & operator[](size_t i) {return p[i];}
+		inline const T & operator[](size_t i) const {return p[i];}
+		inline void swap(TileBuffer &rhs) {std::swap(n, rhs.n); p.swap(rhs.p);}
+};
+
+// matrix stored on disk as square tiles, tile-major with row-major tiles
+// edge tiles are padded with zeros to the full tile size
+// operations stream tiles through a TileBudget and read the next tiles in the
+// background while the current ones are computed
+template<typename T>
+class TiledMatrix
+{
+	static_assert(std::is_trivially_copyable<T>::value, "TiledMatrix requires trivially copyable elements");
+
+	private:
+		struct header
+		{
+			char magic[8];
+			uint64_t rows, cols, tile, size;
+		};
+
+		int fd;
+		size_t num_row, num_col, num_tile;
+
+		inline TiledMatrix(int file, size_t r, size_t c, size_t t) : fd(file), num_row(r), num_col(c), num_tile(t) {}
+
+		inline off_t offset(size_t bi, size_t bj) const
+		{
+			return sizeof(header) + static_cast<off_t>(bi * tile_cols() + bj) * tile_elements() * sizeof(T);
+		}
+
+		static inline void pread_all(int fd, void *buf, size_t len, off_t off)
+		{
+			char *p = static_cast<char *>(buf);
+			while (len > 0)
+			{
+				ssize_t got = ::pread(fd, p, len, off);
+				if (got <= 0)
+					throw std::ios_base::failure("reading tile failed");
+				p += got;
+				len -= got;
+				off += got;
+			}
+		}
+		static inline void pwrite_all(int fd, const void *buf, size_t len, off_t off)
+		{
+			const char *p = static_cast<const char *>(buf);
+			while (len > 0)
+			{
+				ssize_t put = ::pwrite(fd, p, len, off);
+				if (put <= 0)
+					throw std::ios_base::failure("writing tile failed");
+				p += put;
+				len -= put;
+				off += put;
+			}
+		}
+
+		inline void write_header() const
+		{
+			header h = {{'M', 'T', 'X', 'T', 'I', 'L', 'E', '1'}, num_row, num_col, num_tile, sizeof(T)};
+			pwrite_all(fd, &h, sizeof(h), 0);
+		}
+
+		// panels are columns of tiles, stored as tile_rows() * tile_size() rows of tile_size() elements
+		inline void read_panel(size_t bj, T *buf) const
+		{
+			for (size_t bi = 0; bi < tile_rows(); bi++)
+				read_tile(bi, bj, buf + bi * tile_elements());
+		}
+		inline void write_panel(size_t bj, const T *buf)
+		{
+			for (size_t bi = 0; bi < tile_rows(); bi++)
+				write_tile(bi, bj, buf + bi * tile_elements());
+		}
+
+		static inline void check_tiles(const TiledMatrix &A, const TiledMatrix &B)
+		{
+			if (A.num_tile != B.num_tile)
+				throw std::invalid_argument("out-of-core operation on different tile sizes");
+		}
+
+		// check if two matrices are backed by the same file, also when opened twice
+		static inline bool same_file(const TiledMatrix &A, const TiledMatrix &B)
+		{
+			struct stat a, b;
+			if (::fstat(A.fd, &a) != 0 || ::fstat(B.fd, &b) != 0)
+				throw std::ios_base::failure("cannot stat tile file");
+			return a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+		}
+
+	public:
+		// destructor
+		inline ~TiledMatrix()
+		{
+			if (fd >= 0)
+				::close(fd);
+		}
+
+		TiledMatrix(const TiledMatrix &) = delete;
+		TiledMatrix & operator=(const TiledMatrix &) = delete;
+		inline TiledMatrix(TiledMatrix &&A) noexcept : fd(A.fd), num_row(A.num_row), num_col(A.num_col), num_tile(A.num_tile) {A.fd = -1;}
+		inline TiledMatrix & operator=(TiledMatrix &&A) noexcept
+		{
+			std::swap(fd, A.fd);
+			num_row = A.num_row;
+			num_col = A.num_col;
+			num_tile = A.num_tile;
+			return *this;
+		}
+
+		// create a zero matrix backed by a new file
+		static inline TiledMatrix create(const std::string &path, size_t rows, size_t cols, size_t tile)
+		{
+			if (tile == 0)
+				throw std::invalid_argument("tile size is 0");
+			int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0)
+				throw std::ios_base::failure("cannot create " + path);
+			TiledMatrix A(fd, rows, cols, tile);
+			A.write_header();
+			if (::ftruncate(fd, A.offset(A.tile_rows(), 0)) != 0)
+				throw std::ios_base::failure("cannot resize " + path);
+			return A;
+		}
+
+		// open an existing file
+		static inline TiledMatrix open(const std::string &path)
+		{
+			int fd = ::open(path.c_str(), O_RDWR);
+			if (fd < 0)
+				throw std::ios_base::failure("cannot open " + path);
+			TiledMatrix A(fd, 0, 0, 1);
+			header h;
+			pread_all(fd, &h, sizeof(h), 0);
+			if (std::memcmp(h.magic, "MTXTILE1", 8) != 0 || h.size != sizeof(T) || h.tile == 0)
+				throw std::ios_base::failure("not a tiled matrix of this element type: " + path);
+			A.num_row = h.rows;
+			A.num_col = h.cols;
+			A.num_tile = h.tile;
+			return A;
+		}
+
+		// tile size that lets an operation holding n tiles fit in the budget
+		static inline size_t tile_for_budget(size_t bytes, size_t n = 5)
+		{
+			size_t t = static_cast<size_t>(std::sqrt(static_cast<double>(bytes / n / sizeof(T))));
+			return std::max<size_t>(t, 1);
+		}
+
+		// tile size that lets lu of a matrix with the given rows fit in the budget,
+		// it holds 3 panels of tile_rows * t * t elements and the row permutation,
+		// 1 if no size does
+		static inline size_t tile_for_lu(size_t bytes, size_t rows)
+		{
+			size_t perm = rows * sizeof(size_t);
+			size_t elements = (bytes > perm ? bytes - perm : 0) / sizeof(T) / 3, r = std::max<size_t>(rows, 1);
+			size_t t = std::max<size_t>(elements / r, 1);
+			while (t > 1 && (r + t - 1) / t * t * t > elements)
+				t--;
+			return t;
+		}
+
+		// dimensions
+		inline size_t row() const {return num_row;}
+		inline size_t col() const {return num_col;}
+		inline size_t tile_size() const {return num_tile;}
+		inline size_t tile_rows() const {return (num_row + num_tile - 1) / num_tile;}
+		inline size_t tile_cols() const {return (num_col + num_tile - 1) / num_tile;}
+		inline size_t tile_elements() const {return num_tile * num_tile;}
+
+		// tile access
+		inline void read_tile(size_t bi, size_t bj, T *buf) const
+		{
+			pread_all(fd, buf, tile_elements() * sizeof(T), offset(bi, bj));
+		}
+		inline void write_tile(size_t bi, size_t bj, const T *buf)
+		{
+			pwrite_all(fd, buf, tile_elements() * sizeof(T), offset(bi, bj));
+		}
+
+		// conversion from and to an in-memory Matrix
+		static inline TiledMatrix from_matrix(const Matrix<T> &A, const std::string &path, size_t tile)
+		{
+			TiledMatrix B = create(path, A.row(), A.col(), tile);
+			std::vector<T> buf(B.tile_elements());
+			for (size_t bi = 0; bi < B.tile_rows(); bi++)
+				for (size_t bj = 0; bj < B.tile_cols(); bj++)
+				{
+					std::fill(buf.begin(), buf.end(), static_cast<T>(0));
+					for (size_t i = bi * tile; i < std::min(A.row(), (bi + 1) * tile); i++)
+						for (size_t j = bj * tile; j < std::min(A.col(), (bj + 1) * tile); j++)
+							buf[(i - bi * tile) * tile + j - bj * tile] = A.get(i, j);
+					B.write_tile(bi, bj, buf.data());
+				}
+			return B;
+		}
+		inline Matrix<T> to_matrix() const
+		{
+			Matrix<T> A(num_row, num_col);
+			std::vector<T> buf(tile_elements());
+			for (size_t bi = 0; bi < tile_rows(); bi++)
+				for (size_t bj = 0; bj < tile_cols(); bj++)
+				{
+					read_tile(bi, bj, buf.data());
+					for (size_t i = bi * num_tile; i < std::min(num_row, (bi + 1) * num_tile); i++)
+						for (size_t j = bj * num_tile; j < std::min(num_col, (bj + 1) * num_tile); j++)
+							A.get(i, j) = buf[(i - bi * num_tile) * num_tile + j - bj * num_tile];
+				}
+			return A;
+		}
+
+		// import tab separated text, one strip of tile rows in memory at a time
+		template<typename Char>
+		static inline TiledMatrix import(std::basic_istream<Char> &is, const std::string &path, size_t tile, TileBudget &budget)
+		{
+			TiledMatrix A = create(path, 0, 0, tile);
+			std::basic_string<Char> line;
+			std::basic_istringstream<Char> iss;
+			std::vector<T> first;
+			if (std::getline(is, line) && !line.empty())
+			{
+				iss.str(line);
+				T entry;
+				while (iss >> entry)
+					first.push_back(entry);
+				if (!iss.eof())
+					throw std::invalid_argument("line 1: invalid entry");
+			}
+			A.num_col = first.size();
+			if (A.num_col == 0)
+				return A;
+			TileBuffer<T> strip(budget, tile * A.tile_cols() * tile);
+			size_t r = 0;
+			bool more = true;
+			while (more)
+			{
+				std::fill(strip.data(), strip.data() + strip.size(), static_cast<T>(0));
+				size_t i = 0;
+				for (; i < tile; i++)
+				{
+					std::vector<T> v;
+					if (r == 0)
+						v = std::move(first);
+					else if (!std::getline(is, line) || line.empty())
+					{
+						more = false;
+						break;
+					}
+					else
+					{
+						iss.clear();
+						iss.str(line);
+						T entry;
+						while (iss >> entry)
+							v.push_back(entry);
+						if (!iss.eof())
+							throw std::invalid_argument("line " + std::to_string(r + 1) + ": invalid entry");
+					}
+					if (v.size() != A.num_col)
+						throw std::invalid_argument("line " + std::to_string(r + 1) + ": wrong number of columns");
+					for (size_t j = 0; j < v.size(); j++)
+						strip[(j / tile) * tile * tile + i * tile + j % tile] = v[j];
+					r++;
+				}
+				if (i == 0)
+					break;
+				A.num_row = r;
+				size_t bi = (r - 1) / tile;
+				for (size_t bj = 0; bj < A.tile_cols(); bj++)
+					A.write_tile(bi, bj, strip.data() + bj * tile * tile);
+			}
+			A.write_header();
+			return A;
+		}
+
+		// export as tab separated text, one strip of tile rows in memory at a time
+		template<typename Char>
+		inline void export_to(std::basic_ostream<Char> &os, TileBudget &budget) const
+		{
+			TileBuffer<T> strip(budget, num_tile * tile_cols() * num_tile);
+			for (size_t bi = 0; bi < tile_rows(); bi++)
+			{
+				for (size_t bj = 0; bj < tile_cols(); bj++)
+					read_tile(bi, bj, strip.data() + bj * tile_elements());
+				for (size_t i = 0; i < num_tile && bi * num_tile + i < num_row; i++)
+				{
+					for (size_t j = 0; j < num_col; j++)
+					{
+						if (j != 0)
+							os << static_cast<Char>('\t');
+						os << strip[(j / num_tile) * tile_elements() + i * num_tile + j % num_tile];
+					}
+					os << static_cast<Char>('\n');
+				}
+			}
+		}
+
+		// C = A + B, holding the current and next pair of tiles
+		static inline void add(const TiledMatrix &A, const TiledMatrix &B, TiledMatrix &C, TileBudget &budget)
+		{
+			check_tiles(A, B);
+			check_tiles(A, C);
+			if (A.row() != B.row() || A.col() != B.col() || A.row() != C.row() || A.col() != C.col())
+				throw std::invalid_argument("matrix addition with incompatible dimensions");
+			size_t n = A.tile_elements(), count = A.tile_rows() * A.tile_cols();
+			TileBuffer<T> a(budget, n), b(budget, n), na(budget, n), nb(budget, n);
+			std::future<void> next;
+			auto load = [&](size_t t, T *pa, T *pb)
+			{
+				A.read_tile(t / A.tile_cols(), t % A.tile_cols(), pa);
+				B.read_tile(t / A.tile_cols(), t % A.tile_cols(), pb);
+			};
+			if (count > 0)
+				load(0, a.data(), b.data());
+			for (size_t t = 0; t < count; t++)
+			{
+				if (t + 1 < count)
+					next = std::async(std::launch::async, load, t + 1, na.data(), nb.data());
+				for (size_t k = 0; k < n; k++)
+					a[k] += b[k];
+				C.write_tile(t / A.tile_cols(), t % A.tile_cols(), a.data());
+				if (t + 1 < count)
+				{
+					next.get();
+					a.swap(na);
+					b.swap(nb);
+				}
+			}
+		}
+
+		// C = A * B, accumulating one tile of C while the next pair of tiles is read
+		static inline void multiply(const TiledMatrix &A, const TiledMatrix &B, TiledMatrix &C, TileBudget &budget)
+		{
+			check_tiles(A, B);
+			check_tiles(A, C);
+			if (A.col() != B.row() || A.row() != C.row() || B.col() != C.col())
+				throw std::invalid_argument("matrix multiplication with incompatible dimensions");
+			// tiles of C are written while tiles of A and B are still to be read
+			if (same_file(A, C) || same_file(B, C))
+				throw std::invalid_argument("out-of-core multiplication into one of its operands");
+			size_t t = A.tile_size(), n = A.tile_elements(), inner = A.tile_cols();
+			TileBuffer<T> c(budget, n), a(budget, n), b(budget, n), na(budget, n), nb(budget, n);
+			// steps enumerate (i, j, k) with k fastest
+			size_t count = C.tile_rows() * C.tile_cols() * inner;
+			std::future<void> next;
+			auto load = [&](size_t s, T *pa, T *pb)
+			{
+				size_t k = s % inner, ij = s / inner;
+				A.read_tile(ij / C.tile_cols(), k, pa);
+				B.read_tile(k, ij % C.tile_cols(), pb);
+			};
+			if (count > 0)
+				load(0, a.data(), b.data());
+			for (size_t s = 0; s < count; s++)
+			{
+				if (s + 1 < count)
+					next = std::async(std::launch::async, load, s + 1, na.data(), nb.data());
+				if (s % inner == 0)
+					std::fill(c.data(), c.data() + n, static_cast<T>(0));
+				for (size_t i = 0; i < t; i++)
+					for (size_t k = 0; k < t; k++)
+					{
+						T l = a[i * t + k];
+						if (l == static_cast<T>(0))
+							continue;
+						T *cr = c.data() + i * t;
+						const T *br = b.data() + k * t;
+						for (size_t j = 0; j < t; j++)
+							cr[j] += l * br[j];
+					}
+				if (s % inner == inner - 1)
+					C.write_tile(s / inner / C.tile_cols(), s / inner % C.tile_cols(), c.data());
+				if (s + 1 < count)
+				{
+					next.get();
+					a.swap(na);
+					b.swap(nb);
+				}
+			}
+		}
+
+		// in-place LU decomposition with partial pivoting, left-looking over panels
+		// of tile columns; holds the current panel, the earlier panel being applied
+		// and the next earlier panel read in the background
+		// sets p, a buffer of A.row() entries charged against the same budget, such that
+		// row i of the factors is row p[i] of the original matrix,
+		// L is unit lower triangular below the diagonal and U on and above it
+		static inline void lu(TiledMatrix &A, TileBuffer<size_t> &p, TileBudget &budget)
+		{
+			size_t w = A.tile_size(), R = A.tile_rows() * w, m = A.row(), panels = A.tile_cols();
+			if (p.size() != m)
+				throw std::invalid_argument("permutation buffer of the wrong size");
+			TileBuffer<T> cur(budget, R * w), prev(budget, R * w), next_prev(budget, R * w);
+			std::iota(p.data(), p.data() + m, 0);
+			std::future<void> next;
+			auto P = [&](TileBuffer<T> &buf, size_t r, size_t c) -> T & {return buf[r * w + c];};
+
+			for (size_t bj = 0; bj < panels; bj++)
+			{
+				A.read_panel(bj, cur.data());
+				size_t width = std::min(w, A.col() - bj * w);
+
+				// apply the earlier panels
+				if (bj > 0)
+					A.read_panel(0, prev.data());
+				for (size_t bk = 0; bk < bj; bk++)
+				{
+					if (bk + 1 < bj)
+						next = std::async(std::launch::async, [&A, &next_prev, bk]() {A.read_panel(bk + 1, next_prev.data());});
+					size_t k0 = bk * w, steps = k0 < m ? std::min(w, m - k0) : 0;
+					// U block by forward substitution with the unit lower triangle
+					for (size_t s = 0; s < steps; s++)
+						for (size_t q = 0; q < s; q++)
+						{
+							T l = P(prev, p[k0 + s], q);
+							if (l == static_cast<T>(0))
+								continue;
+							T *dst = &P(cur, p[k0 + s], 0);
+							const T *src = &P(cur, p[k0 + q], 0);
+							for (size_t c = 0; c < width; c++)
+								dst[c] -= l * src[c];
+						}
+					// trailing rows
+					for (size_t i = k0 + steps; i < m; i++)
+					{
+						T *dst = &P(cur, p[i], 0);
+						for (size_t q = 0; q < steps; q++)
+						{
+							T l = P(prev, p[i], q);
+							if (l == static_cast<T>(0))
+								continue;
+							const T *src = &P(cur, p[k0 + q], 0);
+							for (size_t c = 0; c < width; c++)
+								dst[c] -= l * src[c];
+						}
+					}
+					if (bk + 1 < bj)
+					{
+						next.get();
+						prev.swap(next_prev);
+					}
+				}
+
+				// factor the panel
+				for (size_t t = 0; t < width && bj * w + t < m; t++)
+				{
+					size_t q = bj * w + t, piv = q;
+					for (size_t i = q + 1; i < m; i++)
+						if (std::abs(P(cur, p[i], t)) > std::abs(P(cur, p[piv], t)))
+							piv = i;
+					std::swap(p[q], p[piv]);
+					T pivot = P(cur, p[q], t);
+					if (pivot == static_cast<T>(0))
+						continue;
+					const T *src = &P(cur, p[q], 0);
+					for (size_t i = q + 1; i < m; i++)
+					{
+						T *dst = &P(cur, p[i], 0);
+						T l = dst[t] /= pivot;
+						if (l == static_cast<T>(0))
+							continue;
+						for (size_t c = t + 1; c < width; c++)
+							dst[c] -= l * src[c];
+					}
+				}
+				A.write_panel(bj, cur.data());
+			}
+
+			// move the rows into pivot order
+			for (size_t bj = 0; bj < panels; bj++)
+			{
+				A.read_panel(bj, cur.data());
+				for (size_t i = 0; i < m; i++)
+					std::copy(&P(cur, p[i], 0), &P(cur, p[i], 0) + w, &P(prev, i, 0));
+				for (size_t i = m; i < R; i++)
+					std::fill(&P(prev, i, 0), &P(prev, i, 0) + w, static_cast<T>(0));
+				A.write_panel(bj, prev.data());
+			}
+		}
+};
+
+#endif
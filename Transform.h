@@ -0,0 +1,123 @@
+
+#ifndef _TRANSFORM_H_
+#define _TRANSFORM_H_
+
+#include <stdexcept>
+#include <ios>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <exception>
+#include <cstddef>
+#include "Matrix.h"
+#include "Tuning.h"
+
+// default number of vectors transformed together
+const size_t transform_block = 256;
+
+// applies a fixed matrix to a stream of vectors, grouping them into blocks
+// so that each block is a single matrix product
+template<typename T>
+class StreamTransform
+{
+	private:
+		// transposed matrix, a block of vectors as rows times it gives the results as rows
+		Matrix<T> At;
+		Matrix<T> queued;
+		size_t used, block;
+
+	public:
+		inline StreamTransform(const Matrix<T> &A, size_t block_size = transform_block)
+			: At(A.col(), A.row()), used(0), block(block_size == 0 ? 1 : block_size)
+		{
+			for (size_t i = 0; i < A.row(); i++)
+				for (size_t j = 0; j < A.col(); j++)
+					At.get(j, i) = A.get(i, j);
+		}
+
+		// dimensions of the input and output vectors
+		inline size_t input_size() const {return At.row();}
+		inline size_t output_size() const {return At.col();}
+
+		// number of queued vectors and the most queued at once
+		inline size_t size() const {return used;}
+		inline size_t block_size() const {return block;}
+
+		// queue a vector, returns true once the block is full
+		inline bool push(const std::vector<T> &x)
+		{
+			if (x.size() != input_size())
+				throw std::invalid_argument("linear transformation with incompatible dimensions");
+			if (used == 0)
+				queued.resize(block, input_size());
+			for (size_t j = 0; j < x.size(); j++)
+				queued.get(used, j) = x[j];
+			return ++used == block;
+		}
+
+		// take the queued vectors as the rows of a block
+		inline Matrix<T> take()
+		{
+			Matrix<T> X;
+			X.swap(queued);
+			X.resize(used, input_size());
+			used = 0;
+			return X;
+		}
+
+		// transform a block of vectors stored as rows, safe to call concurrently
+		inline Matrix<T> apply(const Matrix<T> &X) const {return X * At;}
+};
+
+// read the vectors of a stream, one per line up to a blank line or the end of input,
+// and pass the blocks of st to f, each once it is full or no more input is waiting;
+// after a bad line the rest of the vectors are skipped and its error is rethrown
+template<typename T, typename Char, typename F>
+inline void read_blocks(StreamTransform<T> &st, std::basic_istream<Char> &is, F f)
+{
+	std::basic_string<Char> line;
+	std::exception_ptr error;
+	while (std::getline(is, line) && !line.empty())
+	{
+		if (error)
+			continue;
+		try
+		{
+			std::basic_istringstream<Char> iss(line);
+			std::vector<T> x;
+			while (!iss.eof())
+			{
+				T entry;
+				if (!(iss >> entry))
+					throw std::ios_base::failure("invalid vector: " + std::string(line.begin(), line.end()));
+				x.push_back(entry);
+			}
+			if (st.push(x) || is.rdbuf()->in_avail() <= 0)
+				f(st.take());
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+	}
+	if (st.size() != 0)
+		f(st.take());
+	if (error)
+		std::rethrow_exception(error);
+}
+
+// apply A to the vectors of a stream, writing the results one per line in order
+template<typename T, typename Char>
+inline void transform_stream(const Matrix<T> &A, std::basic_istream<Char> &is, std::basic_ostream<Char> &os, size_t block = transform_block)
+{
+	StreamTransform<T> st(A, block);
+	read_blocks(st, is, [&st, &os](const Matrix<T> &X)
+		{
+			os << st.apply(X);
+			os.flush();
+		});
+}
+
+#endif
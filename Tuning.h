@@ -0,0 +1,187 @@
+
+#ifndef _TUNING_H_
+#define _TUNING_H_
+
+#include <ios>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <type_traits>
+#include <cstddef>
+
+// machine dependent parameters of the blocked and parallel kernels
+struct TuningParams
+{
+	// edge of the square tiles of a product
+	size_t mul_block;
+	// threads of a product and of an elimination
+	size_t mul_threads, ref_threads;
+	// least work worth splitting across threads: multiply-adds of a product,
+	// entries updated per pivot of an elimination
+	size_t mul_parallel, ref_parallel;
+	// largest order whose determinant uses cofactor expansion
+	size_t det_naive;
+};
+
+// parameters used until tuned, computed once
+inline const TuningParams & default_tuning()
+{
+	static const TuningParams defaults = []()
+		{
+			size_t threads = std::thread::hardware_concurrency();
+			if (threads == 0)
+				threads = 1;
+			return TuningParams{64, threads, threads, 1 << 18, 1 << 14, 3};
+		}();
+	return defaults;
+}
+
+template<typename T>
+class Frac;
+
+// name of an element type in the tuning file, the same for every compiler and build,
+// types without one share the untuned defaults
+template<typename T>
+struct tuning_key
+{
+	static inline std::string name()
+	{
+		if constexpr (std::is_floating_point<T>::value)
+			return "float" + std::to_string(sizeof(T) * 8);
+		else if constexpr (std::is_integral<T>::value)
+			return (std::is_signed<T>::value ? "int" : "uint") + std::to_string(sizeof(T) * 8);
+		else
+			return "";
+	}
+};
+template<typename T>
+struct tuning_key<Frac<T>>
+{
+	static inline std::string name()
+	{
+		std::string n = tuning_key<T>::name();
+		return n.empty() ? n : "frac_" + n;
+	}
+};
+
+// tuned parameters by element type
+class TuningTable
+{
+	private:
+		std::map<std::string, TuningParams> table;
+		std::mutex lock;
+		// bumped on every change, so cached parameters know when to refresh
+		std::atomic<size_t> changes{1};
+
+		typedef size_t TuningParams::*field_t;
+		static inline const std::map<std::string, field_t> & fields()
+		{
+			static const std::map<std::string, field_t> names = {
+				{"mul_block", &TuningParams::mul_block},
+				{"mul_threads", &TuningParams::mul_threads},
+				{"ref_threads", &TuningParams::ref_threads},
+				{"mul_parallel", &TuningParams::mul_parallel},
+				{"ref_parallel", &TuningParams::ref_parallel},
+				{"det_naive", &TuningParams::det_naive}
+			};
+			return names;
+		}
+
+	public:
+		static inline TuningTable & instance()
+		{
+			static TuningTable t;
+			return t;
+		}
+
+		inline size_t version() const {return changes.load(std::memory_order_acquire);}
+
+		inline TuningParams get(const std::string &type)
+		{
+			if (type.empty())
+				return default_tuning();
+			std::lock_guard<std::mutex> guard(lock);
+			auto it = table.find(type);
+			return it == table.end() ? default_tuning() : it->second;
+		}
+
+		inline void set(const std::string &type, const TuningParams &p)
+		{
+			if (type.empty())
+				return;
+			std::lock_guard<std::mutex> guard(lock);
+			table[type] = p;
+			changes++;
+		}
+
+		// read lines of "type parameter value", missing parameters keep their defaults
+		// returns false if the file does not exist
+		inline bool load(const std::string &path)
+		{
+			std::ifstream is(path);
+			if (!is)
+				return false;
+			std::map<std::string, TuningParams> loaded;
+			std::string line;
+			for (size_t n = 1; std::getline(is, line); n++)
+			{
+				if (line.empty() || line[0] == '#')
+					continue;
+				std::istringstream iss(line);
+				std::string type, name;
+				size_t value;
+				if (!(iss >> type >> name >> value) || !fields().count(name))
+					throw std::ios_base::failure(path + ':' + std::to_string(n) + ": invalid tuning line");
+				if (!loaded.count(type))
+					loaded[type] = get(type);
+				loaded[type].*fields().at(name) = value;
+			}
+			std::lock_guard<std::mutex> guard(lock);
+			for (const std::pair<const std::string, TuningParams> &p : loaded)
+				table[p.first] = p.second;
+			changes++;
+			return true;
+		}
+
+		inline void save(const std::string &path)
+		{
+			std::ofstream os(path);
+			os << "# matrix tuning: type parameter value" << std::endl;
+			std::lock_guard<std::mutex> guard(lock);
+			for (const std::pair<const std::string, TuningParams> &p : table)
+				for (const std::pair<const std::string, field_t> &f : fields())
+					os << p.first << ' ' << f.first << ' ' << p.second.*f.second << std::endl;
+			if (!os)
+				throw std::ios_base::failure("cannot write " + path);
+		}
+};
+
+// query and override the parameters of an element type,
+// each thread keeps a copy until the table changes
+template<typename T>
+inline TuningParams tuning()
+{
+	thread_local size_t seen = 0;
+	thread_local TuningParams cached;
+	TuningTable &t = TuningTable::instance();
+	size_t v = t.version();
+	if (v != seen)
+	{
+		cached = t.get(tuning_key<T>::name());
+		seen = v;
+	}
+	return cached;
+}
+
+template<typename T>
+inline void set_tuning(const TuningParams &p) {TuningTable::instance().set(tuning_key<T>::name(), p);}
+
+// tuning file
+inline bool load_tuning(const std::string &path) {return TuningTable::instance().load(path);}
+inline void save_tuning(const std::string &path) {TuningTable::instance().save(path);}
+
+#endif
@@ -7,6 +7,44 @@
 #include <cstddef>
 #include <utility>
 
+// accumulator for sums of products
+// exact types specialize it to defer normalization, add() and get() return false
+// when the specialized representation overflows and the plain loop must be used
+template<typename T>
+struct dot_accumulator
+{
+	T sum;
+	inline dot_accumulator() : sum(static_cast<T>(0)) {}
+	inline bool add(const T &a, const T &b) {sum += a * b; return true;}
+	inline bool get(T &result) const {result = sum; return true;}
+};
+
+// sum of products of two ranges, through the accumulator while it can add the terms,
+// then on from its partial sum in plain arithmetic, over again if even that is out of range
+template<typename T, typename It0, typename It1>
+inline T dot_product(It0 first0, It0 last0, It1 first1)
+{
+	dot_accumulator<T> acc;
+	It0 it0 = first0;
+	It1 it1 = first1;
+	while (it0 != last0 && acc.add(*it0, *it1))
+	{
+		++it0;
+		++it1;
+	}
+	T result = static_cast<T>(0);
+	if (acc.get(result))
+	{
+		first0 = it0;
+		first1 = it1;
+	}
+	else
+		result = static_cast<T>(0);
+	while (first0 != last0)
+		result += *(first0++) * *(first1++);
+	return result;
+}
+
 template<typename T, bool C = false>
 class Vector : private std::vector<typename std::conditional<C, const T *, T *>::type>
 {
@@ -155,6 +193,13 @@ class Vector : private std::vector<typename std::conditional<C, const T *, T *>:
 
 		Vector(const Vector &) = delete;
 
+		// move-constructor, takes over the data and the pointers into it
+		inline Vector(Vector &&v) noexcept : std::vector<T_CV*>(std::move(static_cast<std::vector<T_CV*> &>(v))), data(v.data)
+		{
+			v.data = nullptr;
+			v.std::vector<T_CV*>::clear();
+		}
+
 		// copy-constructor with rvlaue
 		template<bool C_RHS>
 		inline Vector(Vector<T, C_RHS> &&v) : data(nullptr)
@@ -220,19 +265,39 @@ class Vector : private std::vector<typename std::conditional<C, const T *, T *>:
 
 		Vector & operator=(const Vector &) = delete;
 
+		// move-assign operator, releases the data owned so far
+		inline Vector & operator=(Vector &&v) noexcept
+		{
+			if (&v == this)
+				return *this;
+			T *old = data;
+			data = v.data;
+			v.data = nullptr;
+			std::vector<T_CV*>::operator=(std::move(static_cast<std::vector<T_CV*> &>(v)));
+			v.std::vector<T_CV*>::clear();
+			if (old != nullptr)
+				delete [] old;
+			return *this;
+		}
+
 		// copy-assign operator with rvalue
 		template<bool C_RHS>
 		inline Vector & operator=(Vector<T, C_RHS> &&v)
 		{
+			typedef std::vector<typename std::conditional<C_RHS, const T *, T *>::type> rhs_base;
+			T *old = data;
 			data = v.data;
+			v.data = nullptr;
 			if (own_data())
-			{
 				construct_self(v.size(), false);
-				v.data = nullptr;
-				v.clear();
-			}
 			else
-				std::vector<T_CV*>::operator=(std::forward(v));
+			{
+				const rhs_base &p = v;
+				std::vector<T_CV*>::assign(p.begin(), p.end());
+			}
+			v.std::vector<typename rhs_base::value_type>::clear();
+			if (old != nullptr)
+				delete [] old;
 			return *this;
 		}
 
@@ -319,10 +384,21 @@ class Vector : private std::vector<typename std::conditional<C, const T *, T *>:
 		template<typename scalar>
 		inline Vector && operator/=(scalar c) && {*this /= c; return std::move(*this);}
 
-		// division by a scalar
+		// division by a scalar, a temporary owning its data is reused
+		template<typename scalar>
+		inline Vector operator/(scalar c) const &
+		{
+			return copy() /= c;
+		}
 		template<typename scalar>
-		inline Vector operator/(scalar c) const
+		inline Vector operator/(scalar c) &&
 		{
+			if constexpr (!C)
+				if (own_data())
+				{
+					*this /= c;
+					return std::move(*this);
+				}
 			return copy() /= c;
 		}
 
@@ -337,10 +413,21 @@ class Vector : private std::vector<typename std::conditional<C, const T *, T *>:
 		template<typename scalar>
 		inline Vector && operator*=(scalar c) && {*this *= c; return std::move(*this);}
 
-		// multiplication with a scalar
+		// multiplication with a scalar, a temporary owning its data is reused
+		template<typename scalar>
+		inline Vector operator*(scalar c) const &
+		{
+			return copy() *= c;
+		}
 		template<typename scalar>
-		inline Vector operator*(scalar c) const
+		inline Vector operator*(scalar c) &&
 		{
+			if constexpr (!C)
+				if (own_data())
+				{
+					*this *= c;
+					return std::move(*this);
+				}
 			return copy() *= c;
 		}
 		template<typename scalar>
@@ -348,6 +435,12 @@ class Vector : private std::vector<typename std::conditional<C, const T *, T *>:
 		{
 			return v * c;
 		}
+		// only for scalars, a Matrix times a temporary Vector is a linear transformation
+		template<typename scalar, typename = decltype(std::declval<T &>() *= std::declval<scalar>())>
+		friend inline Vector operator*(scalar c, Vector &&v)
+		{
+			return std::move(v) * c;
+		}
 
 		// compound addition with a Vector
 		template<bool C_RHS>
@@ -361,13 +454,24 @@ class Vector : private std::vector<typename std::conditional<C, const T *, T *>:
 				*(it0++) += *(it1++);
 			return *this;
 		}
-		template<typename scalar>
-		inline Vector && operator+=(scalar c) && {*this += c; return std::move(*this);}
+		template<bool C_RHS>
+		inline Vector && operator+=(const Vector<T, C_RHS> &rhs) && {*this += rhs; return std::move(*this);}
 
-		// addition Vectors
+		// addition Vectors, a temporary owning its data is reused
+		template<bool C_RHS>
+		inline Vector operator+(const Vector<T, C_RHS> &rhs) const &
+		{
+			return copy() += rhs;
+		}
 		template<bool C_RHS>
-		inline Vector operator+(const Vector<T, C_RHS> &rhs) const
+		inline Vector operator+(const Vector<T, C_RHS> &rhs) &&
 		{
+			if constexpr (!C)
+				if (own_data())
+				{
+					*this += rhs;
+					return std::move(*this);
+				}
 			return copy() += rhs;
 		}
 
@@ -383,15 +487,26 @@ class Vector : private std::vector<typename std::conditional<C, const T *, T *>:
 				*(it0++) -= *(it1++);
 			return *this;
 		}
-		template<typename scalar>
-		inline Vector && operator-=(scalar c) && {*this -= c; return std::move(*this);}
+		template<bool C_RHS>
+		inline Vector && operator-=(const Vector<T, C_RHS> &rhs) && {*this -= rhs; return std::move(*this);}
 
-		// subtraction by a Vector
+		// subtraction by a Vector, a temporary owning its data is reused
 		template<bool C_RHS>
-		inline Vector operator-(const Vector<T, C_RHS> &rhs) const
+		inline Vector operator-(const Vector<T, C_RHS> &rhs) const &
 		{
 			return copy() -= rhs;
 		}
+		template<bool C_RHS>
+		inline Vector operator-(const Vector<T, C_RHS> &rhs) &&
+		{
+			if constexpr (!C)
+				if (own_data())
+				{
+					*this -= rhs;
+					return std::move(*this);
+				}
+			return copy() -= rhs;
+		}
 
 		// dot product
 		template<bool C_RHS>
@@ -399,12 +514,7 @@ class Vector : private std::vector<typename std::conditional<C, const T *, T *>:
 		{
 			if (size() != rhs.size())
 				throw std::invalid_argument("dot product between different dimensions");
-			T result = static_cast<T>(0);
-			auto it0 = begin();
-			auto it1 = rhs.begin();
-			while (it0 != end())
-				result += *(it0++) * *(it1++);
-			return result;
+			return dot_product<T>(begin(), end(), rhs.begin());
 		}
 };
 
@@ -2,14 +2,89 @@
 #include "prec.h"
 
 const char unknow_msg[] = "Unknown command: ";
-class continue_signal {};
 
-typedef Matrix<Frac<unsigned int>> matrix_t;
+// thrown for command lines that are not understood
+class unknown_command
+{
+	public:
+		std::string cmd;
+};
+
+typedef Frac<unsigned int> scalar_t;
+typedef Matrix<scalar_t> matrix_t;
+
+// default memory cap of the result cache in bytes
+const size_t default_cache_size = 64 << 20;
+
+// capacity of the queues between the stages of the batch pipeline
+const size_t pipeline_depth = 64;
+
+// size of the buffers copying between the terminal and the server
+const size_t client_buffer = 4096;
+
+// clients a server serves at once, later ones wait in the listen backlog
+const size_t max_clients = 64;
+
+// tuning file in the home directory, loaded at startup and written by --tune
+inline std::string default_tuning_file()
+{
+	const char *home = std::getenv("HOME");
+	return std::string(home ? home : ".") + "/.matrix_tuning";
+}
+
+// matrix held in a register or produced by a command, with its content hash;
+// integral matrices are held in narrow integer storage, the others as fractions
+struct value_t
+{
+	std::shared_ptr<const matrix_t> matrix;
+	std::shared_ptr<const IntMatrix> ints;
+	size_t hash;
+
+	inline size_t row() const {return ints ? ints->row() : matrix->row();}
+	inline size_t col() const {return ints ? ints->col() : matrix->col();}
+
+	// the entries as fractions, converted for integral matrices
+	inline std::shared_ptr<const matrix_t> fractions() const
+	{
+		if (matrix)
+			return matrix;
+		std::shared_ptr<matrix_t> A = std::make_shared<matrix_t>();
+		ints->to_matrix(*A);
+		return A;
+	}
+};
+
+// result of a command that may still be computing
+typedef std::shared_future<value_t> pending_t;
+
+// output of a parsed command line, waits for its results
+typedef std::function<void(std::ostream &)> job_t;
+
+// runs a computation, inline or on a worker
+typedef std::function<pending_t(std::function<value_t()>)> launcher_t;
+
+// queues output ahead of the job of the command line being parsed
+typedef std::function<void(job_t)> emitter_t;
+
+// operands and result of a memoized command
+struct cache_entry
+{
+	std::vector<value_t> operands;
+	value_t result;
+};
+
+// memoized results shared by concurrent computations
+struct result_cache
+{
+	LRUCache<std::string, cache_entry> lru;
+	std::mutex lock;
+	inline result_cache(size_t capacity) : lru(capacity) {}
+};
 
 // throw i/o exceptions manually to avoid abi difference of std::ios_base::failure
-inline void check_input()
+inline void check_input(std::istream &is = std::cin)
 {
-	if (std::cin.fail())
+	if (is.fail())
 		throw std::ios_base::failure("invalid input");
 }
 
@@ -25,8 +100,286 @@ inline bool prompt(std::string &cmd)
 
 inline void unknown(const std::string &cmd)
 {
-	std::cout << "\e[31m" << unknow_msg << "\e[1m" << cmd << "\e[0m" << std::endl;
-	throw continue_signal();
+	throw unknown_command{cmd};
+}
+
+// print the error of the command being handled
+inline void report(std::ostream &os, std::ostream &err)
+{
+	try
+	{
+		throw;
+	}
+	catch (const unknown_command &e)
+	{
+		os << "\e[31m" << unknow_msg << "\e[1m" << e.cmd << "\e[0m" << std::endl;
+	}
+	catch (const std::invalid_argument &e)
+	{
+		err << "\e[31mInvalid argument: " << e.what() << "\e[0m" << std::endl;
+	}
+	catch (const std::ios_base::failure &e)
+	{
+		err << "\e[31mI/O Failure: " << e.what() << "\e[0m" << std::endl;
+	}
+	// e.g. out of memory or out of threads, fails the command but not the session
+	catch (const std::exception &e)
+	{
+		err << "\e[31mError: " << e.what() << "\e[0m" << std::endl;
+	}
+}
+
+// content hash of a matrix
+inline size_t hash_matrix(const matrix_t &A)
+{
+	size_t h = std::hash<size_t>()(A.row()) * 31 + A.col();
+	for (size_t i = 0; i < A.row(); i++)
+		for (size_t j = 0; j < A.col(); j++)
+		{
+			const scalar_t &f = A.get(i, j);
+			h = h * 1000003 ^ std::hash<unsigned int>()(f.num);
+			h = h * 1000003 ^ std::hash<unsigned int>()(f.den);
+			h = h * 1000003 ^ (f.neg && f.num != 0);
+		}
+	return h;
+}
+
+inline size_t hash_matrix(const IntMatrix &A)
+{
+	size_t h = std::hash<size_t>()(A.row()) * 31 + A.col();
+	for (size_t i = 0; i < A.row(); i++)
+		for (size_t j = 0; j < A.col(); j++)
+		{
+			int64_t x = A.get(i, j);
+			h = h * 1000003 ^ std::hash<unsigned int>()(static_cast<unsigned int>(x < 0 ? -x : x));
+			h = h * 1000003 ^ std::hash<unsigned int>()(1);
+			h = h * 1000003 ^ (x < 0);
+		}
+	return h;
+}
+
+// content equality of matrices
+inline bool same_matrix(const matrix_t &A, const matrix_t &B)
+{
+	if (A.row() != B.row() || A.col() != B.col())
+		return false;
+	for (size_t i = 0; i < A.row(); i++)
+		for (size_t j = 0; j < A.col(); j++)
+		{
+			const scalar_t &a = A.get(i, j), &b = B.get(i, j);
+			if (a.num != b.num || a.den != b.den || (a.num != 0 && a.neg != b.neg))
+				return false;
+		}
+	return true;
+}
+
+inline bool same_matrix(const IntMatrix &A, const IntMatrix &B)
+{
+	if (A.row() != B.row() || A.col() != B.col())
+		return false;
+	for (size_t i = 0; i < A.row(); i++)
+		for (size_t j = 0; j < A.col(); j++)
+			if (A.get(i, j) != B.get(i, j))
+				return false;
+	return true;
+}
+
+// integral matrices are always held as integers, so values of different storage differ
+inline bool same_value(const value_t &a, const value_t &b)
+{
+	if (a.ints && b.ints)
+		return a.ints == b.ints || same_matrix(*a.ints, *b.ints);
+	if (a.matrix && b.matrix)
+		return a.matrix == b.matrix || same_matrix(*a.matrix, *b.matrix);
+	return false;
+}
+
+// approximate memory used by a matrix
+inline size_t matrix_size(const matrix_t &A)
+{
+	return sizeof(matrix_t) + A.row() * (sizeof(std::vector<scalar_t>) + A.col() * sizeof(scalar_t));
+}
+
+inline size_t value_size(const value_t &v)
+{
+	return v.ints ? sizeof(IntMatrix) + v.ints->bytes() : matrix_size(*v.matrix);
+}
+
+// reject requests needing more memory than allowed, a limit of 0 allows any
+inline void check_limit(size_t bytes, size_t limit)
+{
+	if (limit != 0 && bytes > limit)
+		throw std::invalid_argument("request needs about " + std::to_string(bytes)
+			+ " bytes, over the memory limit of " + std::to_string(limit));
+}
+
+// files the load command may read: none, any, or those under a resolved directory
+struct load_policy
+{
+	bool allowed;
+	std::string root;
+};
+
+const load_policy load_any{true, ""};
+
+// path to read for load FILE, throws if the policy does not allow it
+inline std::string load_path(const load_policy &files, const std::string &path)
+{
+	if (!files.allowed)
+		throw std::invalid_argument("load is disabled on this server");
+	if (files.root.empty())
+		return path;
+	std::unique_ptr<char, void (*)(void *)> resolved(::realpath((files.root + '/' + path).c_str(), nullptr), std::free);
+	if (resolved == nullptr)
+		throw std::ios_base::failure("cannot open " + path);
+	std::string full = resolved.get(), prefix = files.root.back() == '/' ? files.root : files.root + '/';
+	if (full.compare(0, prefix.size(), prefix) != 0)
+		throw std::invalid_argument(path + " is outside of the load directory");
+	return full;
+}
+
+// integer results must fit in the scalar type, throws std::overflow_error otherwise
+inline value_t make_value(IntMatrix &&A)
+{
+	if (!int_entry<scalar_t>::fits(static_cast<int64_t>(A.max_abs())))
+		throw std::overflow_error("integer matrix entries exceed the scalar type");
+	A.shrink();
+	size_t h = hash_matrix(A);
+	return value_t{nullptr, std::make_shared<const IntMatrix>(std::move(A)), h};
+}
+
+inline value_t make_value(matrix_t &&A)
+{
+	IntMatrix I;
+	if (IntMatrix::from_matrix(A, I))
+		return make_value(std::move(I));
+	size_t h = hash_matrix(A);
+	return value_t{std::make_shared<const matrix_t>(std::move(A)), nullptr, h};
+}
+
+inline value_t read_value(std::istream &is)
+{
+	matrix_t A;
+	is >> A;
+	check_input(is);
+	return make_value(std::move(A));
+}
+
+// result that is already available
+inline pending_t ready(value_t v)
+{
+	std::promise<value_t> p;
+	p.set_value(std::move(v));
+	return p.get_future().share();
+}
+
+// print output right away
+inline void print_now(job_t job)
+{
+	job(std::cout);
+}
+
+// run a computation on the calling thread
+inline pending_t run_inline(std::function<value_t()> f)
+{
+	std::promise<value_t> p;
+	try
+	{
+		p.set_value(f());
+	}
+	catch (...)
+	{
+		p.set_exception(std::current_exception());
+	}
+	return p.get_future().share();
+}
+
+// output of results
+inline void print_matrix(std::ostream &os, const matrix_t &A)
+{
+	os << A << std::endl;
+}
+
+inline void print_scalar(std::ostream &os, const matrix_t &A)
+{
+	os << A.get(0, 0) << std::endl;
+}
+
+// method of the solve command, chosen on the command line: exact elimination,
+// or a Krylov method in double precision with a preconditioner
+struct solve_method_t
+{
+	std::string method, precond;
+	SolverOptions options;
+};
+
+solve_method_t solve_method{"exact", "jacobi", default_solver_options()};
+
+inline bool valid_solve_method(const solve_method_t &s)
+{
+	return (s.method == "exact" || s.method == "cg" || s.method == "bicgstab" || s.method == "gmres")
+		&& (s.precond == "none" || s.precond == "jacobi" || s.precond == "ilu");
+}
+
+// A x = b in exact arithmetic, false also when the check overflows
+inline bool solves_exactly(const matrix_t &A, const matrix_t &x, const matrix_t &b)
+{
+	for (size_t i = 0; i < A.row(); i++)
+	{
+		dot_accumulator<scalar_t> acc;
+		for (size_t j = 0; j < A.col(); j++)
+			if (A.get(i, j).num != 0 && !acc.add(A.get(i, j), x.get(j, 0)))
+				return false;
+		scalar_t sum;
+		if (!acc.get(sum))
+			return false;
+		const scalar_t &c = b.get(i, 0);
+		if (sum.num != c.num || sum.den != c.den || (c.num != 0 && sum.neg != c.neg))
+			return false;
+	}
+	return true;
+}
+
+// solve iteratively, then round the solution to fractions, the simplest first,
+// keeping only a rounding that solves the system exactly: the residual bound
+// of the solver says nothing of how close x is to a fraction
+inline matrix_t iterative_solve(const matrix_t &A, const matrix_t &b)
+{
+	const solve_method_t &s = solve_method;
+	SparseMatrix<double> S(A);
+	std::unique_ptr<Preconditioner<double>> M;
+	if (s.precond == "jacobi")
+		M.reset(new JacobiPreconditioner<double>(S));
+	else if (s.precond == "ilu")
+		M.reset(new ILU0Preconditioner<double>(S));
+	else
+		M.reset(new IdentityPreconditioner<double>());
+	std::vector<double> rhs(b.row()), x;
+	for (size_t i = 0; i < b.row(); i++)
+		rhs[i] = static_cast<double>(b.get(i, 0));
+	SolverReport report = s.method == "cg" ? cg(S, rhs, x, *M, s.options)
+		: s.method == "bicgstab" ? bicgstab(S, rhs, x, *M, s.options)
+		: gmres(S, rhs, x, *M, s.options);
+	std::ostringstream oss;
+	oss << s.method << " after " << report.iterations << " iterations, relative residual " << report.residual;
+	if (!report.converged)
+		throw std::invalid_argument(oss.str() + ", did not converge");
+	matrix_t R(x.size(), 1);
+	for (double rounding = 1e-4; rounding >= 1e-14; rounding *= 1e-2)
+	{
+		try
+		{
+			for (size_t i = 0; i < x.size(); i++)
+				R.get(i, 0) = approximate_frac<unsigned int>(x[i], rounding);
+		}
+		catch (const std::invalid_argument &)
+		{
+			break;
+		}
+		if (solves_exactly(A, R, b))
+			return R;
+	}
+	throw std::invalid_argument(oss.str() + ", no nearby fractions solve the system exactly, use --solver exact");
 }
 
 const char * help_msg[] = {
@@ -38,76 +391,694 @@ const char * help_msg[] = {
 	"	\e[1mdet\e[0m:	calculate determinant",
 	"	\e[1madd\e[0m:	matrix addition",
 	"	\e[1msub\e[0m:	matrix subtraction",
-	"	\e[1mmul\e[0m:	matrix multiplication"
+	"	\e[1mmul\e[0m:	matrix multiplication, of any number of registers in the cheapest order",
+	"	\e[1mrank\e[0m:	calculate rank",
+	"	\e[1msolve\e[0m:	solve a linear system, the right-hand side as a column, by the method of --solver",
+	"	\e[1mnull\e[0m:	basis of the nullspace as columns",
+	"	\e[1mcharpoly\e[0m:	characteristic polynomial from the highest degree",
+	"	\e[1mtransform\e[0m:	apply a matrix to the following vectors, one per line up to a blank line",
+	"	\e[1mvars\e[0m:	list registers",
+	"	\e[1mload NAME FILE\e[0m:	load the matrix in FILE into register NAME, up to its first blank line",
+	"Registers:",
+	"	\e[1mNAME =\e[0m:	store the following matrix in register NAME",
+	"	\e[1mNAME = command ...\e[0m:	store the result of a command in register NAME",
+	"	\e[1mNAME\e[0m:	show register NAME",
+	"	operands of a command may be given as register names, e.g. \e[1mmul A B\e[0m,",
+	"	missing operands are read from input"
 };
 
 const struct
 {
 	std::string name;
-	void (*function)();
+	// number of matrix operands, read from input when missing
+	size_t arity;
+	// more operands may be given as registers
+	bool variadic;
+	// memoize results
+	bool cached;
+	value_t (*compute)(const std::vector<value_t> &);
+	void (*print)(std::ostream &, const matrix_t &);
 } commands[] = {
-	
-	{"help", []()
+
+	{"ref", 1, false, true, [](const std::vector<value_t> &v)
 		{
-			for (const char *msg : help_msg)
-				std::cout << msg << std::endl;
-			throw continue_signal();
-		}
+			return make_value(v[0].fractions()->ref());
+		},
+		print_matrix
 	},
 
-	{"ref", []()
+	{"det", 1, false, true, [](const std::vector<value_t> &v)
 		{
-			matrix_t A;
-			std::cin >> A;
-			check_input();
-			std::cout << A.ref() << std::endl;
-			throw continue_signal();
-		}
+			// fraction-free elimination in the integer storage
+			if (v[0].ints && v[0].row() == v[0].col())
+			{
+				try
+				{
+					IntMatrix A(*v[0].ints), R(1, 1);
+					int64_t d;
+					A.bareiss(&d);
+					R.set(0, 0, d);
+					return make_value(std::move(R));
+				}
+				catch (const std::overflow_error &)
+				{
+				}
+			}
+			matrix_t R(1, 1);
+			R.get(0, 0) = hybrid_det(*v[0].fractions());
+			return make_value(std::move(R));
+		},
+		print_scalar
 	},
 
-	{"det", []()
+	{"add", 2, false, false, [](const std::vector<value_t> &v)
 		{
-			matrix_t A;
-			std::cin >> A;
-			check_input();
-			std::cout << A.det() << std::endl;
-			throw continue_signal();
-		}
+			if (v[0].ints && v[1].ints)
+			{
+				try
+				{
+					return make_value(*v[0].ints + *v[1].ints);
+				}
+				catch (const std::overflow_error &)
+				{
+				}
+			}
+			return make_value(*v[0].fractions() + *v[1].fractions());
+		},
+		print_matrix
 	},
 
-	{"add", []()
+	{"sub", 2, false, false, [](const std::vector<value_t> &v)
 		{
-			matrix_t A, B;
-			std::cin >> A >> B;
-			check_input();
-			std::cout << A+B << std::endl;
-			throw continue_signal();
-		}
+			if (v[0].ints && v[1].ints)
+			{
+				try
+				{
+					return make_value(*v[0].ints - *v[1].ints);
+				}
+				catch (const std::overflow_error &)
+				{
+				}
+			}
+			return make_value(*v[0].fractions() - *v[1].fractions());
+		},
+		print_matrix
 	},
 
-	{"sub", []()
+	{"mul", 2, true, true, [](const std::vector<value_t> &v)
 		{
-			matrix_t A, B;
-			std::cin >> A >> B;
-			check_input();
-			std::cout << A-B << std::endl;
-			throw continue_signal();
-		}
+			std::vector<const IntMatrix *> ints;
+			for (const value_t &f : v)
+				if (f.ints)
+					ints.push_back(f.ints.get());
+			if (ints.size() == v.size())
+			{
+				try
+				{
+					return make_value(int_chain_product(ints));
+				}
+				catch (const std::overflow_error &)
+				{
+				}
+			}
+			std::vector<std::shared_ptr<const matrix_t>> held;
+			std::vector<const matrix_t *> factors;
+			for (const value_t &f : v)
+			{
+				held.push_back(f.fractions());
+				factors.push_back(held.back().get());
+			}
+			return make_value(chain_product(factors));
+		},
+		print_matrix
+	},
+
+	{"rank", 1, false, true, [](const std::vector<value_t> &v)
+		{
+			matrix_t R(1, 1);
+			if (v[0].ints)
+			{
+				try
+				{
+					IntMatrix A(*v[0].ints);
+					R.get(0, 0) = scalar_t(A.bareiss());
+					return make_value(std::move(R));
+				}
+				catch (const std::overflow_error &)
+				{
+				}
+			}
+			R.get(0, 0) = scalar_t(hybrid_rank(*v[0].fractions()));
+			return make_value(std::move(R));
+		},
+		print_scalar
+	},
+
+	{"solve", 2, false, true, [](const std::vector<value_t> &v)
+		{
+			std::shared_ptr<const matrix_t> A = v[0].fractions(), b = v[1].fractions();
+			if (b->col() != 1)
+				throw std::invalid_argument("right-hand side must be a single column");
+			if (solve_method.method != "exact")
+				return make_value(iterative_solve(*A, *b));
+			Vector<scalar_t> x = hybrid_solve(*A, b->col(0));
+			matrix_t R(x.size(), 1);
+			for (size_t i = 0; i < x.size(); i++)
+				R.get(i, 0) = x[i];
+			return make_value(std::move(R));
+		},
+		print_matrix
 	},
 
-	{"mul", []()
+	{"null", 1, false, true, [](const std::vector<value_t> &v)
+		{
+			return make_value(v[0].fractions()->null());
+		},
+		[](std::ostream &os, const matrix_t &N)
 		{
-			matrix_t A, B;
-			std::cin >> A >> B;
-			check_input();
-			std::cout << A*B << std::endl;
-			throw continue_signal();
+			if (N.col() == 0)
+				os << "{0}" << std::endl << std::endl;
+			else
+				os << N << std::endl;
 		}
+	},
+
+	{"charpoly", 1, false, true, [](const std::vector<value_t> &v)
+		{
+			// division-free, keeps the coefficients of integer input integral
+			std::vector<scalar_t> p = v[0].fractions()->charpoly_berkowitz();
+			matrix_t R(1, p.size());
+			for (size_t k = 0; k < p.size(); k++)
+				R.get(0, k) = p[p.size() - 1 - k];
+			return make_value(std::move(R));
+		},
+		print_matrix
 	}
 };
 
-int main()
+typedef decltype(commands[0]) command_t;
+
+// estimated peak memory of a command: its operands, a working copy of them,
+// and a result as large as the operands or as their product
+inline size_t working_size(const std::vector<value_t> &operands)
+{
+	size_t bytes = 0;
+	for (const value_t &v : operands)
+		bytes += 2 * value_size(v);
+	if (operands.size() >= 2)
+	{
+		const value_t &A = operands.front(), &B = operands.back();
+		bytes += sizeof(matrix_t) + A.row() * (sizeof(std::vector<scalar_t>) + B.col() * sizeof(scalar_t));
+	}
+	return bytes;
+}
+
+// compute a command, memoizing its result by the content hashes of the operands
+inline value_t compute(const std::remove_reference<command_t>::type &command, const std::vector<value_t> &operands, result_cache &cache)
+{
+	if (!command.cached)
+		return command.compute(operands);
+
+	// verified against the stored operands
+	std::string key = command.name;
+	for (const value_t &v : operands)
+		key += ':' + std::to_string(v.hash);
+	cache_entry hit;
+	bool found;
+	{
+		std::lock_guard<std::mutex> guard(cache.lock);
+		found = cache.lru.get(key, hit);
+	}
+	if (found)
+	{
+		bool same = true;
+		for (size_t i = 0; same && i < operands.size(); i++)
+			same = same_value(hit.operands[i], operands[i]);
+		if (same)
+			return hit.result;
+	}
+
+	value_t result = command.compute(operands);
+	size_t cost = value_size(result);
+	for (const value_t &v : operands)
+		cost += value_size(v);
+	std::lock_guard<std::mutex> guard(cache.lock);
+	cache.lru.put(key, cache_entry{operands, result}, cost);
+	return result;
+}
+
+// a command line session with registers
+// command lines are parsed into jobs: operands are read from input right away,
+// computations are handed to the launcher, and the job prints the result
+class Session
 {
+	private:
+		std::istream &in;
+		result_cache &cache;
+		launcher_t launch;
+		// per-request memory limit in bytes, 0 for none
+		size_t limit;
+		emitter_t emit;
+		load_policy files;
+		std::map<std::string, pending_t> registers;
+
+		static inline const std::remove_reference<command_t>::type * find(const std::string &name)
+		{
+			for (command_t command : commands)
+				if (name == command.name)
+					return &command;
+			return nullptr;
+		}
+
+		static inline bool valid_name(const std::string &name)
+		{
+			if (name.empty() || !std::isalpha(static_cast<unsigned char>(name[0])))
+				return false;
+			for (char c : name)
+				if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_')
+					return false;
+			return find(name) == nullptr && name != "help" && name != "exit" && name != "vars" && name != "transform" && name != "load";
+		}
+
+		// start a command on register operands, reading missing ones from input
+		inline pending_t evaluate(const std::vector<std::string> &tokens)
+		{
+			const std::remove_reference<command_t>::type *command = find(tokens[0]);
+			if (command == nullptr)
+				unknown(tokens[0]);
+			if (tokens.size() - 1 > command->arity && !command->variadic)
+				throw std::invalid_argument("too many operands for " + command->name);
+			std::vector<pending_t> operands;
+			for (size_t i = 1; i < tokens.size(); i++)
+			{
+				auto it = registers.find(tokens[i]);
+				if (it == registers.end())
+					throw std::invalid_argument("unknown register " + tokens[i]);
+				operands.push_back(it->second);
+			}
+			while (operands.size() < command->arity)
+				operands.push_back(ready(read()));
+
+			result_cache &c = cache;
+			size_t l = limit;
+			return launch([command, operands, &c, l]()
+				{
+					std::vector<value_t> v;
+					for (const pending_t &f : operands)
+						v.push_back(f.get());
+					check_limit(working_size(v), l);
+					return compute(*command, v, c);
+				});
+		}
+
+		// stream vectors through a matrix in blocks, the transformed blocks are
+		// computed by the launcher and emitted in order as they are read
+		inline job_t transform(const std::vector<std::string> &tokens)
+		{
+			if (tokens.size() > 2)
+				throw std::invalid_argument("too many operands for transform");
+			pending_t A;
+			if (tokens.size() == 2)
+			{
+				auto it = registers.find(tokens[1]);
+				if (it == registers.end())
+					throw std::invalid_argument("unknown register " + tokens[1]);
+				A = it->second;
+			}
+			else
+				A = ready(read());
+			std::shared_ptr<StreamTransform<scalar_t>> st = std::make_shared<StreamTransform<scalar_t>>(*A.get().fractions());
+			read_blocks(*st, in, [this, st](matrix_t &&X)
+				{
+					std::shared_ptr<const matrix_t> block = std::make_shared<const matrix_t>(std::move(X));
+					pending_t result = launch([st, block]() {return make_value(st->apply(*block));});
+					emit([result](std::ostream &os) {os << *result.get().fractions();});
+				});
+			return [](std::ostream &os) {os << std::endl;};
+		}
+
+		inline value_t read()
+		{
+			value_t v = read_value(in);
+			check_limit(value_size(v), limit);
+			return v;
+		}
+
+	public:
+		inline Session(std::istream &is, result_cache &c, launcher_t l = run_inline, size_t memory_limit = 0, emitter_t e = print_now,
+				const load_policy &load_files = load_any)
+			: in(is), cache(c), launch(l), limit(memory_limit), emit(e), files(load_files) {}
+
+		// parse one command line
+		inline job_t parse(const std::string &line)
+		{
+			std::string spaced;
+			for (char c : line)
+				if (c == '=')
+					spaced += " = ";
+				else
+					spaced += c;
+			std::istringstream iss(spaced);
+			std::vector<std::string> tokens;
+			for (std::string t; iss >> t;)
+				tokens.push_back(t);
+			if (tokens.empty())
+				unknown(line);
+
+			// assignment, waits only to surface errors in order
+			if (tokens.size() >= 2 && tokens[1] == "=")
+			{
+				if (!valid_name(tokens[0]))
+					throw std::invalid_argument("invalid register name " + tokens[0]);
+				pending_t result = tokens.size() == 2 ? ready(read())
+					: evaluate(std::vector<std::string>(tokens.begin() + 2, tokens.end()));
+				registers[tokens[0]] = result;
+				return [result](std::ostream &) {result.get();};
+			}
+
+			if (tokens.size() == 1 && tokens[0] == "help")
+				return [](std::ostream &os)
+					{
+						for (const char *msg : help_msg)
+							os << msg << std::endl;
+					};
+			if (tokens.size() == 1 && tokens[0] == "vars")
+				return [registers = registers](std::ostream &os)
+					{
+						for (const std::pair<const std::string, pending_t> &r : registers)
+						{
+							const value_t &A = r.second.get();
+							os << r.first << ":\t" << A.row() << 'x' << A.col() << std::endl;
+						}
+					};
+			if (tokens[0] == "transform")
+				return transform(tokens);
+			if (tokens[0] == "load")
+			{
+				if (tokens.size() != 3)
+					throw std::invalid_argument("usage: load NAME FILE");
+				if (!valid_name(tokens[1]))
+					throw std::invalid_argument("invalid register name " + tokens[1]);
+				std::string path = load_path(files, tokens[2]), name = tokens[2];
+				size_t l = limit;
+				pending_t result = launch([path, name, l]()
+					{
+						value_t v = make_value(load_matrix<scalar_t>(path, 0, name));
+						check_limit(value_size(v), l);
+						return v;
+					});
+				registers[tokens[1]] = result;
+				return [result](std::ostream &) {result.get();};
+			}
+			if (tokens.size() == 1 && registers.count(tokens[0]))
+			{
+				pending_t result = registers[tokens[0]];
+				return [result](std::ostream &os) {print_matrix(os, *result.get().fractions());};
+			}
+			const std::remove_reference<command_t>::type *command = find(tokens[0]);
+			if (command == nullptr)
+				unknown(line);
+			pending_t result = evaluate(tokens);
+			return [command, result](std::ostream &os) {command->print(os, *result.get().fractions());};
+		}
+};
+
+// batch mode: parsing on this thread, computations on the pool, and output
+// in input order on its own thread, connected by bounded queues
+inline void run_batch(std::istream &in, std::ostream &out, std::ostream &err, result_cache &cache, ThreadPool &pool, size_t limit,
+	const load_policy &files = load_any)
+{
+	// reading must not flush the output the printer is writing
+	std::ostream *tied = in.tie(nullptr);
+	BoundedQueue<job_t> output(pipeline_depth);
+	std::thread printer([&output, &out, &err]()
+		{
+			job_t job;
+			while (output.pop(job))
+			{
+				try
+				{
+					job(out);
+				}
+				catch (...)
+				{
+					report(out, err);
+				}
+			}
+		});
+	Session session(in, cache, [&pool](std::function<value_t()> f) {return pool.submit(std::move(f));}, limit,
+		[&output](job_t job) {output.push(std::move(job));}, files);
+	std::string cmd;
+	while (std::getline(in, cmd) && cmd != "exit")
+	{
+		try
+		{
+			output.push(session.parse(cmd));
+		}
+		catch (...)
+		{
+			if (in.eof())
+				break;
+			in.clear();
+			output.push([e = std::current_exception()](std::ostream &) {std::rethrow_exception(e);});
+		}
+	}
+	output.close();
+	printer.join();
+	in.tie(tied);
+}
+
+// server mode: each client connection is a batch session of its own,
+// all of them sharing the worker pool and the result cache
+// clients may load files only under the directory of files, if any
+inline void run_server(const std::string &path, result_cache &cache, ThreadPool &pool, size_t limit, const load_policy &files)
+{
+	int server = listen_unix(path);
+	// connections being served, shared with the detached connection threads
+	struct slots_t
+	{
+		std::mutex lock;
+		std::condition_variable freed;
+		size_t used = 0;
+	};
+	std::shared_ptr<slots_t> slots = std::make_shared<slots_t>();
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> guard(slots->lock);
+			slots->freed.wait(guard, [&slots]() {return slots->used < max_clients;});
+		}
+		int client = ::accept(server, nullptr, nullptr);
+		if (client < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE)
+				continue;
+			::close(server);
+			throw std::ios_base::failure("cannot accept on " + path);
+		}
+		{
+			std::lock_guard<std::mutex> guard(slots->lock);
+			slots->used++;
+		}
+		std::thread([client, &cache, &pool, limit, &files, slots]()
+			{
+				try
+				{
+					// separate buffers, the printer writes while the parser reads
+					fd_streambuf inbuf(client), outbuf(client);
+					std::istream in(&inbuf);
+					std::ostream out(&outbuf);
+					run_batch(in, out, out, cache, pool, limit, files);
+				}
+				catch (const std::exception &)
+				{
+					// only this connection is dropped
+				}
+				::close(client);
+				std::lock_guard<std::mutex> guard(slots->lock);
+				slots->used--;
+				slots->freed.notify_one();
+			}).detach();
+	}
+}
+
+// client mode: send standard input to a server and copy its replies to standard output
+inline void run_client(const std::string &path)
+{
+	int server = connect_unix(path);
+	std::thread replies([server]()
+		{
+			char buf[client_buffer];
+			ssize_t got;
+			while ((got = ::read(server, buf, sizeof(buf))) > 0 || (got < 0 && errno == EINTR))
+				if (got > 0)
+					std::cout.write(buf, got).flush();
+		});
+	char buf[client_buffer];
+	while (std::cin.read(buf, sizeof(buf)) || std::cin.gcount() > 0)
+	{
+		const char *p = buf, *end = buf + std::cin.gcount();
+		while (p < end)
+		{
+			ssize_t put = ::send(server, p, end - p, MSG_NOSIGNAL);
+			if (put < 0 && errno == EINTR)
+				continue;
+			if (put <= 0)
+				break;
+			p += put;
+		}
+		if (p < end)
+			break;
+	}
+	// end of requests, the server finishes the pending ones and closes
+	::shutdown(server, SHUT_WR);
+	replies.join();
+	::close(server);
+}
+
+// numeric command line values, the whole argument must parse and counts can not be negative
+inline size_t count_arg(const std::string &arg)
+{
+	if (arg.empty() || arg[0] == '-')
+		throw std::invalid_argument(arg);
+	size_t used = 0;
+	unsigned long long value = std::stoull(arg, &used);
+	if (used != arg.size() || value > std::numeric_limits<size_t>::max())
+		throw std::out_of_range(arg);
+	return value;
+}
+inline double real_arg(const std::string &arg)
+{
+	size_t used = 0;
+	double value = std::stod(arg, &used);
+	if (used != arg.size())
+		throw std::invalid_argument(arg);
+	return value;
+}
+
+int main(int argc, char *argv[])
+{
+	// lets streamed input tell how much of it is already waiting
+	std::ios::sync_with_stdio(false);
+	size_t cache_size = default_cache_size, jobs = std::thread::hardware_concurrency(), limit = 0;
+	bool pipeline = false, tune = false;
+	std::string server, client, tuning_file = default_tuning_file(), load_dir;
+	auto usage = [argv]()
+	{
+		std::cerr << "usage: " << argv[0] << " [--cache BYTES] [--mem-limit BYTES] [--pipeline [--jobs N]]" << std::endl
+			<< "       " << argv[0] << " --server PATH [--cache BYTES] [--mem-limit BYTES] [--jobs N] [--load-dir DIR]" << std::endl
+			<< "       " << argv[0] << " --client PATH" << std::endl
+			<< "       " << argv[0] << " --tune" << std::endl
+			<< "the kernel parameters are loaded from --tuning FILE, " << default_tuning_file() << " by default" << std::endl
+			<< "solve uses --solver exact|cg|bicgstab|gmres, the Krylov methods with" << std::endl
+			<< "[--precond none|jacobi|ilu] [--tol RELATIVE_RESIDUAL] [--max-iter N] [--restart N]" << std::endl;
+		return 1;
+	};
+	try
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (arg == "--cache" && i + 1 < argc)
+				cache_size = count_arg(argv[++i]);
+			else if (arg == "--pipeline")
+				pipeline = true;
+			else if (arg == "--jobs" && i + 1 < argc)
+				jobs = count_arg(argv[++i]);
+			else if (arg == "--mem-limit" && i + 1 < argc)
+				limit = count_arg(argv[++i]);
+			else if (arg == "--server" && i + 1 < argc)
+				server = argv[++i];
+			else if (arg == "--load-dir" && i + 1 < argc)
+				load_dir = argv[++i];
+			else if (arg == "--client" && i + 1 < argc)
+				client = argv[++i];
+			else if (arg == "--tune")
+				tune = true;
+			else if (arg == "--tuning" && i + 1 < argc)
+				tuning_file = argv[++i];
+			else if (arg == "--solver" && i + 1 < argc)
+				solve_method.method = argv[++i];
+			else if (arg == "--precond" && i + 1 < argc)
+				solve_method.precond = argv[++i];
+			else if (arg == "--tol" && i + 1 < argc)
+				solve_method.options.tol = real_arg(argv[++i]);
+			else if (arg == "--max-iter" && i + 1 < argc)
+				solve_method.options.max_iter = count_arg(argv[++i]);
+			else if (arg == "--restart" && i + 1 < argc)
+				solve_method.options.restart = count_arg(argv[++i]);
+			else
+				return usage();
+		}
+	}
+	catch (const std::logic_error &)
+	{
+		// a value that is not a number, or out of range
+		return usage();
+	}
+	if (!valid_solve_method(solve_method))
+	{
+		std::cerr << "unknown solver " << solve_method.method << " or preconditioner " << solve_method.precond << std::endl;
+		return 1;
+	}
+
+	// kernel parameters: tuned on request, otherwise from the tuning file if present
+	try
+	{
+		if (tune)
+		{
+			set_tuning<scalar_t>(autotune<scalar_t>());
+			save_tuning(tuning_file);
+			std::cout << "tuning saved to " << tuning_file << std::endl;
+			return 0;
+		}
+		load_tuning(tuning_file);
+	}
+	catch (const std::ios_base::failure &e)
+	{
+		std::cerr << "\e[31mI/O Failure: " << e.what() << "\e[0m" << std::endl;
+		if (tune)
+			return 1;
+	}
+
+	try
+	{
+		if (!client.empty())
+		{
+			run_client(client);
+			return 0;
+		}
+		if (!server.empty())
+		{
+			// clients load only under --load-dir, and nothing without it
+			load_policy files{!load_dir.empty(), ""};
+			if (files.allowed)
+			{
+				std::unique_ptr<char, void (*)(void *)> root(::realpath(load_dir.c_str(), nullptr), std::free);
+				if (root == nullptr)
+					throw std::ios_base::failure("cannot open " + load_dir);
+				files.root = root.get();
+			}
+			result_cache cache(cache_size);
+			ThreadPool pool(jobs, pipeline_depth);
+			run_server(server, cache, pool, limit, files);
+		}
+	}
+	catch (const std::ios_base::failure &e)
+	{
+		std::cerr << "\e[31mI/O Failure: " << e.what() << "\e[0m" << std::endl;
+		return 1;
+	}
+
+	result_cache cache(cache_size);
+	if (pipeline)
+	{
+		ThreadPool pool(jobs, pipeline_depth);
+		run_batch(std::cin, std::cout, std::cerr, cache, pool, limit);
+		return 0;
+	}
+
+	Session session(std::cin, cache, run_inline, limit);
 	std::string cmd;
 	while (true)
 	{
@@ -115,14 +1086,7 @@ int main()
 		{
 			if (prompt(cmd))
 				return 0;
-			for (const decltype(commands[0]) &command : commands)
-				if (cmd == command.name)
-					command.function();
-			unknown(cmd);
-		}
-		catch (const std::invalid_argument &e)
-		{
-			std::cerr << "\e[31mInvalid argument: " << e.what() << "\e[0m" << std::endl;
+			session.parse(cmd)(std::cout);
 		}
 		catch (const std::ios_base::failure &e)
 		{
@@ -131,9 +1095,12 @@ int main()
 				std::cout << std::endl;
 				return 0;
 			}
-			std::cerr << "\e[31mI/O Failure: " << e.what() << "\e[0m" << std::endl;
+			report(std::cout, std::cerr);
 			std::cin.clear();
 		}
-		catch (continue_signal) {}
+		catch (...)
+		{
+			report(std::cout, std::cerr);
+		}
 	}
 }
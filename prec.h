@@ -5,9 +5,32 @@
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cctype>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <cstdlib>
 #include "Vector.h"
 #include "Matrix.h"
 #include "Frac.h"
+#include "FracVector.h"
+#include "Echelon.h"
+#include "Hybrid.h"
+#include "TiledMatrix.h"
+#include "Cache.h"
+#include "Pipeline.h"
+#include "Socket.h"
+#include "Tuning.h"
+#include "Autotune.h"
+#include "Transform.h"
+#include "IntMatrix.h"
+#include "Loader.h"
+#include "Krylov.h"
 
 #endif
 